@@ -0,0 +1,52 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <string.h>
+#include <pico/stdlib.h>
+#include "arena.h"
+
+typedef struct arena {
+  uint8_t* memory;
+  size_t size;
+  size_t used;
+} arena_t;
+
+static_assert(ARENA_CORE0_SIZE + ARENA_STACK_SIZE <= ARENA_BANK_SIZE, "Core0's arena and stack don't fit in scratch Y");
+static_assert(ARENA_CORE1_SIZE + ARENA_STACK_SIZE <= ARENA_BANK_SIZE, "Core1's arena and stack don't fit in scratch X");
+static_assert(ARENA_MIN_FREE < ARENA_CORE0_SIZE && ARENA_MIN_FREE < ARENA_CORE1_SIZE, "ARENA_MIN_FREE leaves no arena to use");
+
+static uint8_t __scratch_y("arena") __attribute__((aligned(ARENA_ALIGN))) arena_core0_memory[ARENA_CORE0_SIZE];
+static uint8_t __scratch_x("arena") __attribute__((aligned(ARENA_ALIGN))) arena_core1_memory[ARENA_CORE1_SIZE];
+
+static arena_t arenas[2] = {
+  { arena_core0_memory, ARENA_CORE0_SIZE, 0 },
+  { arena_core1_memory, ARENA_CORE1_SIZE, 0 }
+};
+
+void* arena_alloc(size_t size) {
+  arena_t* arena = &arenas[get_core_num()];
+  size_t start = (arena->used + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+  if (start + size > arena->size) {
+    panic("arena %u exhausted: %u + %u > %u", get_core_num(), (uint) start, (uint) size, (uint) arena->size);
+  }
+
+  arena->used = start + size;
+  memset(arena->memory + start, 0, size);
+
+  return arena->memory + start;
+}
+
+size_t arena_high_water(uint core) {
+  return arenas[core].used;
+}
+
+void arena_check() {
+  arena_t* arena = &arenas[get_core_num()];
+  if (arena->used + ARENA_MIN_FREE > arena->size) {
+    panic("arena %u nearly full: %u of %u used", get_core_num(), (uint) arena->used, (uint) arena->size);
+  }
+}
@@ -0,0 +1,73 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <pico/stdlib.h>
+
+/**
+ * Per-core static object arenas. Sizes can be overridden from the build.
+ * Each arena shares a 4K scratch bank with its core's stack (2K by default).
+ */
+#ifndef ARENA_CORE0_SIZE
+#define ARENA_CORE0_SIZE 1536
+#endif
+
+#ifndef ARENA_CORE1_SIZE
+#define ARENA_CORE1_SIZE 1024
+#endif
+
+/** SRAM banks 4 and 5, scratch X and Y */
+#define ARENA_BANK_SIZE 4096
+
+/** Stack each core keeps in its scratch bank. Match PICO_STACK_SIZE and PICO_CORE1_STACK_SIZE */
+#ifndef ARENA_STACK_SIZE
+#define ARENA_STACK_SIZE 0x800
+#endif
+
+/** What `arena_check` wants left free in each arena once a core is done building its objects */
+#ifndef ARENA_MIN_FREE
+#define ARENA_MIN_FREE 128
+#endif
+
+/**
+ * For the statics a GPIO handler finds its object through, since raw handlers take no parameter.
+ * Only the core that registered the handler touches them. The host sim runs an engine per thread
+ * and makes these thread-local.
+ */
+#ifndef ARENA_CORE_LOCAL
+#define ARENA_CORE_LOCAL
+#endif
+
+/** Allocation alignment. Keeps 64-bit fields and DMA buffers happy */
+#define ARENA_ALIGN 8
+
+/**
+ * Allocates zeroed memory from the calling core's arena. There is no free: this is for objects
+ * constructed once at init. Core0's arena lives in SRAM bank 5 (scratch Y) and core1's in
+ * bank 4 (scratch X), so most of a core's own accesses stay off of the striped banks the other
+ * core is using. That's placement, not isolation: core0's plan listener writes the plan into
+ * ignition, in core1's arena, every cycle and reads knock, the limiter and traction from its own
+ * arena for it, and core1's spark path reads the plan back. Keep DMA buffers out of the arenas,
+ * they'd contend with the stack in the same bank. Panics when the arena is exhausted, so an
+ * undersized arena fails at boot rather than in flight.
+ */
+void* arena_alloc(size_t size);
+
+/**
+ * Bytes used in a core's arena. Nothing is ever freed, so this is also the high-water mark.
+ */
+size_t arena_high_water(uint core);
+
+/**
+ * Call on each core once it's done building its objects. Panics if less than ARENA_MIN_FREE is
+ * left in that core's arena, so an arena that's nearly full shows up on the bench the day it
+ * gets there, not when the next object added to it won't fit.
+ */
+void arena_check();
+
+#endif
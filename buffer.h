@@ -1,4 +1,5 @@
 #include "pico/stdlib.h"
+#include "arena.h"
 
 #ifndef BUFFER_H
 #define BUFFER_H
@@ -11,7 +12,7 @@ typedef struct Buffer {
 Buffer buffer_init(uint length) {
   Buffer buffer;
   buffer.length = length;
-  buffer.contents = calloc(length, sizeof(uint));
+  buffer.contents = arena_alloc(length * sizeof(uint));
 
   return buffer;
 }
@@ -0,0 +1,241 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/multicore.h>
+#include <pico/sync.h>
+#include <hardware/flash.h>
+#include <hardware/irq.h>
+#include "calibration.h"
+#include "arena.h"
+#include "state.h"
+#include "tick.h"
+
+struct calibration {
+  uint16_t rpm_min;
+  uint16_t rpm_step;
+  bool active;
+  bool valid;
+  /** Fit since the last save */
+  bool dirty;
+  float sum[CALIBRATION_BINS];
+  uint16_t count[CALIBRATION_BINS];
+  float table[CALIBRATION_BINS];
+
+  // Sense input. Planned sparks of this cycle and the last one, since a spark near TDC can be
+  // sensed after the next trigger has already planned the one after it.
+  Ignition_t ignition;
+  uint sense_pin;
+  tick_t planned[2];
+  bool planned_valid[2];
+  uint32_t physical_period;
+};
+
+typedef struct calibration_flash {
+  uint32_t magic;
+  uint16_t rpm_min;
+  uint16_t rpm_step;
+  float table[CALIBRATION_BINS];
+  uint32_t checksum;
+} calibration_flash_t;
+
+static_assert(sizeof(calibration_flash_t) <= FLASH_PAGE_SIZE, "Saved calibration must fit a flash page");
+
+/** The one calibration the GPIO interrupt reports to */
+static ARENA_CORE_LOCAL Calibration_t calibration_sensed;
+
+Calibration_t calibration_init(uint16_t rpm_min, uint16_t rpm_max) {
+  Calibration_t cal = arena_alloc(sizeof(struct calibration));
+  cal->rpm_min = rpm_min;
+  cal->rpm_step = MAX((rpm_max - rpm_min) / (CALIBRATION_BINS - 1), 1);
+  cal->active = false;
+  cal->valid = false;
+  cal->dirty = false;
+  for (uint8_t i = 0; i < CALIBRATION_BINS; ++i) {
+    cal->table[i] = 0;
+  }
+  cal->ignition = NULL;
+  cal->planned_valid[0] = false;
+  cal->planned_valid[1] = false;
+  cal->physical_period = 0;
+
+  return cal;
+}
+
+static uint32_t calibration_checksum(const calibration_flash_t* saved) {
+  const uint32_t* words = (const uint32_t*) saved;
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < offsetof(calibration_flash_t, checksum) / sizeof(uint32_t); ++i) {
+    sum = (sum << 1 | sum >> 31) + words[i];
+  }
+  return ~sum;
+}
+
+void calibration_load(Calibration_t cal) {
+  const calibration_flash_t* saved = (const calibration_flash_t*) (XIP_BASE + CALIBRATION_FLASH_OFFSET);
+  if (saved->magic != CALIBRATION_MAGIC || saved->checksum != calibration_checksum(saved)) return;
+  // Bins of a different RPM range would be applied at the wrong speeds
+  if (saved->rpm_min != cal->rpm_min || saved->rpm_step != cal->rpm_step) return;
+
+  memcpy(cal->table, saved->table, sizeof(cal->table));
+  cal->valid = true;
+}
+
+void calibration_poll(Calibration_t cal) {
+  if (!cal->dirty || cal->active || state_get().running) return;
+
+  uint8_t page[FLASH_PAGE_SIZE];
+  memset(page, 0xFF, sizeof(page));
+  calibration_flash_t* saved = (calibration_flash_t*) page;
+  saved->magic = CALIBRATION_MAGIC;
+  saved->rpm_min = cal->rpm_min;
+  saved->rpm_step = cal->rpm_step;
+  memcpy(saved->table, cal->table, sizeof(saved->table));
+  saved->checksum = calibration_checksum(saved);
+
+  // Nothing may run from flash while it's being written: park core1, and keep core0's own
+  // handlers out until it's done
+  multicore_lockout_start_blocking();
+  uint32_t interrupts = save_and_disable_interrupts();
+  flash_range_erase(CALIBRATION_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+  flash_range_program(CALIBRATION_FLASH_OFFSET, page, FLASH_PAGE_SIZE);
+  restore_interrupts(interrupts);
+  multicore_lockout_end_blocking();
+
+  cal->dirty = false;
+}
+
+void calibration_begin(Calibration_t cal) {
+  for (uint8_t i = 0; i < CALIBRATION_BINS; ++i) {
+    cal->sum[i] = 0;
+    cal->count[i] = 0;
+  }
+  cal->active = true;
+}
+
+/** Fractional bin position of an engine period, clamped to the table */
+static float calibration_position(Calibration_t cal, uint32_t physical_period) {
+  if (physical_period == 0) return CALIBRATION_BINS - 1;
+  float position = ((float) RPM(physical_period) - cal->rpm_min) / cal->rpm_step;
+  return MIN(MAX(position, 0), CALIBRATION_BINS - 1);
+}
+
+void calibration_record(Calibration_t cal, uint32_t physical_period, float offset_degrees) {
+  if (!cal->active) return;
+  // Round to the nearest bin
+  uint8_t bin = calibration_position(cal, physical_period) + 0.5f;
+  cal->sum[bin] += offset_degrees;
+  ++cal->count[bin];
+}
+
+void calibration_end(Calibration_t cal) {
+  cal->active = false;
+
+  // Populated bins get their mean. Remember the last populated bin to fill gaps.
+  int8_t last = -1;
+  for (uint8_t i = 0; i < CALIBRATION_BINS; ++i) {
+    if (cal->count[i] == 0) continue;
+
+    float mean = cal->sum[i] / cal->count[i];
+    if (last < 0) {
+      // Extrapolate flat below the lowest sample
+      for (uint8_t j = 0; j < i; ++j) {
+        cal->table[j] = mean;
+      }
+    } else {
+      // Interpolate across any gap since the last sample
+      for (uint8_t j = last + 1; j < i; ++j) {
+        cal->table[j] = cal->table[last] + (mean - cal->table[last]) * (j - last) / (i - last);
+      }
+    }
+    cal->table[i] = mean;
+    last = i;
+  }
+
+  if (last < 0) return;
+
+  // Extrapolate flat above the highest sample
+  for (uint8_t j = last + 1; j < CALIBRATION_BINS; ++j) {
+    cal->table[j] = cal->table[last];
+  }
+  cal->valid = true;
+  cal->dirty = true;
+}
+
+float calibration_correction(Calibration_t cal, uint32_t physical_period) {
+  float position = calibration_position(cal, physical_period);
+  uint8_t bin = position;
+  if (bin >= CALIBRATION_BINS - 1) {
+    return cal->table[CALIBRATION_BINS - 1];
+  }
+  float fraction = position - bin;
+
+  return cal->table[bin] + (cal->table[bin + 1] - cal->table[bin]) * fraction;
+}
+
+bool calibration_active(Calibration_t cal) {
+  return cal->active;
+}
+
+bool calibration_valid(Calibration_t cal) {
+  return cal->valid;
+}
+
+void calibration_set_ignition(Calibration_t cal, Ignition_t ign) {
+  cal->ignition = ign;
+}
+
+void calibration_listener(State_t* state, void* param) {
+  Calibration_t cal = param;
+  const ignition_plan_t* plan = ignition_get_plan(cal->ignition);
+  uint8_t slot = state->clock & 1;
+
+  // Cranking sparks come straight off the trigger edge, not the plan
+  cal->planned[slot] = plan->spark;
+  cal->planned_valid[slot] = state->running && !state->cranking && !plan->cut;
+  cal->physical_period = state->physical_period;
+}
+
+/**
+ * Shares the bank interrupt with anyone else on core0, so check it's the sense pin's edge.
+ * Same priority as the trigger alarm, so the listener never changes the plans under it.
+ */
+static void calibration_sense_irq() {
+  Calibration_t cal = calibration_sensed;
+  if (!(gpio_get_irq_event_mask(cal->sense_pin) & GPIO_IRQ_EDGE_RISE)) return;
+  gpio_acknowledge_irq(cal->sense_pin, GPIO_IRQ_EDGE_RISE);
+  if (!cal->active || cal->physical_period == 0) return;
+
+  // Latest planned spark the edge is past. A sense edge has to come after its spark.
+  tick_t now = tick_now();
+  tick_diff_t late = -1;
+  for (uint8_t i = 0; i < 2; ++i) {
+    if (!cal->planned_valid[i]) continue;
+    tick_diff_t diff = tick_diff(now, cal->planned[i]);
+    if (diff >= 0 && (late < 0 || diff < late)) {
+      late = diff;
+    }
+  }
+  if (late < 0 || (uint32_t) late > cal->physical_period >> CALIBRATION_MAX_LATE_SHIFT) return;
+
+  // Moving TDC earlier by the lateness puts the spark where it was planned
+  float late_degrees = late * 360.f / cal->physical_period;
+  State_t state = state_get();
+  calibration_record(cal, cal->physical_period, state.trigger_timing_offset - late_degrees);
+}
+
+void calibration_sense_init(Calibration_t cal, uint pin) {
+  cal->sense_pin = pin;
+  calibration_sensed = cal;
+
+  gpio_init(pin);
+  gpio_set_dir(pin, GPIO_IN);
+  gpio_pull_down(pin);
+  gpio_add_raw_irq_handler(pin, calibration_sense_irq);
+  gpio_set_irq_enabled(pin, GPIO_IRQ_EDGE_RISE, true);
+  irq_set_enabled(IO_IRQ_BANK0, true);
+}
@@ -0,0 +1,98 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <pico/stdlib.h>
+#include <hardware/flash.h>
+#include "state.h"
+#include "ignition.h"
+
+#define CALIBRATION_BINS 8
+/** One sector right below the logger's half of flash, well clear of the program image */
+#define CALIBRATION_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES / 2 - FLASH_SECTOR_SIZE)
+#define CALIBRATION_MAGIC 0x4A43414Cu
+/** A sense edge further than this past the planned spark, in fractions of a period, is noise */
+#define CALIBRATION_MAX_LATE_SHIFT 2
+
+typedef struct calibration* Calibration_t;
+
+/**
+ * Construct a new trigger offset calibration covering `rpm_min` to `rpm_max`.
+ *
+ * Measured calibration (the profile defines CALIBRATION_SENSE_PIN, see `calibration_sense_init`):
+ * start calibrating and sweep the engine through the RPM range. Every spark the sense input
+ * picks up is compared against the time it was planned for, and the lateness, in degrees at
+ * that speed, is taken off the offset.
+ *
+ * Manual calibration (no sense input): lock the timing function to a known value, start
+ * calibrating, then sweep the engine through the RPM range while keeping the timing light on
+ * the mark with the offset potentiometer. Every trigger records the offset that was needed.
+ *
+ * Either way, when calibration ends the samples are fit into an RPM-indexed correction table
+ * which replaces the potentiometer from then on, and which `calibration_poll` saves to flash.
+ */
+Calibration_t calibration_init(uint16_t rpm_min, uint16_t rpm_max);
+
+/**
+ * Load the table saved by `calibration_poll`, if there is one for the same RPM range
+ */
+void calibration_load(Calibration_t cal);
+
+/**
+ * Save a freshly fit table to flash at CALIBRATION_FLASH_OFFSET. Only once the engine has
+ * stopped: the sector erase stalls flash for tens of milliseconds, so core1 is locked out and
+ * core0's interrupts are off meanwhile. Call from core0's main loop.
+ */
+void calibration_poll(Calibration_t cal);
+
+/**
+ * Measure spark latency on `pin`, wired to a coil-sense or plug lead pickup that goes high when
+ * the spark fires. Call from core0, which takes the edge interrupt, and register
+ * `calibration_listener` so there are planned sparks to measure against.
+ */
+void calibration_sense_init(Calibration_t cal, uint pin);
+
+/**
+ * State listener that keeps the planned spark times `ign` publishes, for the sense input to be
+ * measured against. Register after `ignition_plan_listener`.
+ */
+void calibration_listener(State_t* state, void* param);
+
+/**
+ * The ignition whose plans `calibration_listener` reads
+ */
+void calibration_set_ignition(Calibration_t cal, Ignition_t ign);
+
+/**
+ * Enter calibration mode, discarding samples from any previous run
+ */
+void calibration_begin(Calibration_t cal);
+
+/**
+ * Leave calibration mode and fit the correction table. The previous table is kept if
+ * nothing was recorded.
+ */
+void calibration_end(Calibration_t cal);
+
+/**
+ * Record the offset needed at the given engine period
+ */
+void calibration_record(Calibration_t cal, uint32_t physical_period, float offset_degrees);
+
+/**
+ * Correction in degrees for the given engine period, linearly interpolated from the table
+ */
+float calibration_correction(Calibration_t cal, uint32_t physical_period);
+
+/** Calibration run in progress */
+bool calibration_active(Calibration_t cal);
+
+/** A correction table has been fit */
+bool calibration_valid(Calibration_t cal);
+
+#endif
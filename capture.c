@@ -0,0 +1,99 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <pico/stdlib.h>
+#include <hardware/pio.h>
+#include <hardware/dma.h>
+#include <hardware/clocks.h>
+#include "capture.h"
+#include "capture.pio.h"
+#include "arena.h"
+#include "tick.h"
+
+#define CAPTURE_PIO pio0
+
+struct capture {
+  uint8_t pin;
+  uint sm;
+  uint dma_channel;
+  uint32_t last_edges;
+  tick_t last_edge_tick;
+};
+
+/**
+ * DMA targets, one per state machine, each always holding its latest count. Kept in striped
+ * main SRAM rather than in the arena, so every edge's DMA write doesn't land in core0's scratch
+ * bank, next to its stack.
+ */
+static volatile uint32_t capture_counts[NUM_PIO_STATE_MACHINES];
+
+static int capture_program_offset = -1;
+
+Capture_t capture_init(uint8_t pin) {
+  Capture_t cap = arena_alloc(sizeof(struct capture));
+  cap->pin = pin;
+  cap->last_edges = 0;
+  cap->last_edge_tick = tick_now();
+
+  if (capture_program_offset < 0) {
+    capture_program_offset = pio_add_program(CAPTURE_PIO, &capture_program);
+  }
+  cap->sm = pio_claim_unused_sm(CAPTURE_PIO, true);
+  capture_counts[cap->sm] = 0;
+
+  // Copy every count from the FIFO into the same word, forever. The transfer count doubles as
+  // the number of edges seen. At 1kHz it runs out after ~50 days.
+  cap->dma_channel = dma_claim_unused_channel(true);
+  dma_channel_config config = dma_channel_get_default_config(cap->dma_channel);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+  channel_config_set_read_increment(&config, false);
+  channel_config_set_write_increment(&config, false);
+  channel_config_set_dreq(&config, pio_get_dreq(CAPTURE_PIO, cap->sm, false));
+  dma_channel_configure(cap->dma_channel, &config, &capture_counts[cap->sm], &CAPTURE_PIO->rxf[cap->sm], UINT32_MAX, true);
+
+  gpio_init(pin);
+  gpio_set_dir(pin, GPIO_IN);
+  capture_program_init(CAPTURE_PIO, cap->sm, capture_program_offset, pin);
+
+  return cap;
+}
+
+uint32_t capture_edges(Capture_t cap) {
+  return UINT32_MAX - dma_channel_hw_addr(cap->dma_channel)->transfer_count;
+}
+
+uint32_t capture_period_cycles(Capture_t cap) {
+  uint32_t edges = capture_edges(cap);
+  tick_t now = tick_now();
+
+  // The first count runs from when the state machine started, not from an edge
+  if (edges < 2) {
+    return 0;
+  }
+
+  uint32_t count = capture_counts[cap->sm];
+  // Over 17s at 125MHz doesn't fit in 32 bits of cycles, which is a stop in anyone's book
+  if (count >= UINT32_MAX / 2) {
+    return 0;
+  }
+
+  uint32_t period = count * 2 + CAPTURE_OVERHEAD_CYCLES;
+  if (edges != cap->last_edges) {
+    cap->last_edges = edges;
+    cap->last_edge_tick = now;
+    return period;
+  }
+
+  // Nothing new. Stopped if it's been quiet for a few periods
+  uint32_t period_us = period / (clock_get_hz(clk_sys) / 1000000);
+  uint32_t timeout = MIN((uint64_t) period_us * CAPTURE_STALL_PERIODS, CAPTURE_TIMEOUT_US);
+  return (uint32_t) tick_diff(now, cap->last_edge_tick) > timeout ? 0 : period;
+}
+
+float capture_frequency(Capture_t cap) {
+  uint32_t period = capture_period_cycles(cap);
+  return period ? (float) clock_get_hz(clk_sys) / period : 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pico/stdlib.h>
+
+/** Longest period before an input is considered stopped */
+#define CAPTURE_TIMEOUT_US 500000
+/** Input is stopped after this many periods without an edge */
+#define CAPTURE_STALL_PERIODS 3
+
+typedef struct capture* Capture_t;
+
+/**
+ * Period capture on a PIO state machine, for inputs other than the crank (wheel speed,
+ * secondary shafts). The state machine times each period in system clock cycles, and a DMA
+ * channel copies every measurement out of its FIFO, so edges cost the CPU nothing. Readers get
+ * the latest period and the number of edges seen so far.
+ */
+Capture_t capture_init(uint8_t pin);
+
+/**
+ * Latest period between rising edges in system clock cycles. 0 while there isn't a complete
+ * period yet, or once the input has stopped.
+ */
+uint32_t capture_period_cycles(Capture_t cap);
+
+/**
+ * Latest frequency in Hz. 0 while stopped.
+ */
+float capture_frequency(Capture_t cap);
+
+/**
+ * Rising edges seen since init
+ */
+uint32_t capture_edges(Capture_t cap);
+
+#endif
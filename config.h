@@ -0,0 +1,202 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+/**
+ * Engine and board profile. Every firmware target is built against exactly one header from
+ * profiles/, named by DEJA_PROFILE (see CMakeLists.txt), so pins, trigger geometry and dwell
+ * are compile-time constants wherever they're used.
+ */
+#ifndef DEJA_PROFILE
+#define DEJA_PROFILE "profiles/default.h"
+#endif
+
+#include DEJA_PROFILE
+
+/**
+ * Defaults for everything a profile leaves out, so profiles only carry what sets them apart.
+ * Optional hardware has no default and is left out by leaving its pin undefined: CAM_PIN for cam
+ * sync, KNOCK_PIN, BATTERY_PIN (with BATTERY_DIVIDER), CALIBRATION_SENSE_PIN and LAUNCH_PIN for
+ * a clutch or launch switch. So is
+ * IGN_TIMING_LIGHT_DEGREES, to flash at an angle instead of on the spark.
+ */
+
+/** Board */
+#ifndef TRIGGER_PIN
+#define TRIGGER_PIN 13
+#endif
+#ifndef IGN_COIL_PIN
+#define IGN_COIL_PIN 22
+#endif
+#ifndef IGN_TIMING_LIGHT_PIN
+#define IGN_TIMING_LIGHT_PIN 15
+#endif
+#ifndef IGN_MANUAL_TRIGGER_PIN
+#define IGN_MANUAL_TRIGGER_PIN 16
+#endif
+#ifndef CALIBRATION_BUTTON_PIN
+#define CALIBRATION_BUTTON_PIN 17
+#endif
+#ifndef FRONT_WHEEL_PIN
+#define FRONT_WHEEL_PIN 18
+#endif
+#ifndef REAR_WHEEL_PIN
+#define REAR_WHEEL_PIN 19
+#endif
+#ifndef INJECTOR_PIN
+#define INJECTOR_PIN 21
+#endif
+#ifndef TIMING_COURSE_ADJUST_PIN
+#define TIMING_COURSE_ADJUST_PIN 28
+#endif
+#ifndef TIMING_ADC_CHANNEL
+#define TIMING_ADC_CHANNEL 2
+#endif
+#ifndef BATTERY_NOMINAL_MV
+#define BATTERY_NOMINAL_MV 13500 // Assumed without a BATTERY_PIN to measure it on
+#endif
+
+#ifndef SCHEDULER_0_ALARM
+#define SCHEDULER_0_ALARM 1
+#endif
+#ifndef SCHEDULER_1_ALARM
+#define SCHEDULER_1_ALARM 2
+#endif
+
+/** Trigger */
+#ifndef TRIGGER_TYPE
+#define TRIGGER_TYPE TRIGGER_COIL_DIGITAL
+#endif
+#ifndef TRIGGERS_PER_REVOLUTION
+#define TRIGGERS_PER_REVOLUTION 1
+#endif
+#ifndef TRIGGER_POLL_PERIOD
+#define TRIGGER_POLL_PERIOD 20 // Analog trigger sample period. The digital trigger is an edge IRQ
+#endif
+
+/** Cam sync, with a CAM_PIN */
+#ifndef CAM_SYNC_EDGE
+#define CAM_SYNC_EDGE 0 // Phase, in crank edges, of the TDC predicted by the first edge after the cam edge
+#endif
+#ifndef ENGINE_CYLINDERS
+#define ENGINE_CYLINDERS 1
+#endif
+
+/** Ignition */
+#ifndef IGN_DWELL_US
+#define IGN_DWELL_US 1500
+#endif
+#ifndef IGN_FALLBACK_ADVANCE
+#define IGN_FALLBACK_ADVANCE 10.0f // Fixed timing while the spark path is missing deadlines
+#endif
+#ifndef IGN_TIMING_LIGHT_PULSE_US
+#define IGN_TIMING_LIGHT_PULSE_US 0 // No strobe. 100 to enable
+#endif
+
+#ifndef REV_LIMIT_RPM
+#define REV_LIMIT_RPM 10500
+#endif
+#ifndef REV_LIMIT_LAUNCH_RPM
+#define REV_LIMIT_LAUNCH_RPM 6000
+#endif
+#ifndef REV_LIMIT_HYSTERESIS_RPM
+#define REV_LIMIT_HYSTERESIS_RPM 250
+#endif
+#ifndef REV_LIMIT_MODE
+#define REV_LIMIT_MODE LIMITER_PATTERN // LIMITER_SOFT, LIMITER_HARD or LIMITER_PATTERN
+#endif
+#ifndef REV_LIMIT_RETARD_DEGREES
+#define REV_LIMIT_RETARD_DEGREES 10 // LIMITER_SOFT
+#endif
+#ifndef REV_LIMIT_PATTERN_SKIP
+#define REV_LIMIT_PATTERN_SKIP 1 // LIMITER_PATTERN cuts SKIP out of every OF sparks
+#endif
+#ifndef REV_LIMIT_PATTERN_OF
+#define REV_LIMIT_PATTERN_OF 2
+#endif
+#ifndef LAUNCH_ACTIVE_LEVEL
+#define LAUNCH_ACTIVE_LEVEL 0 // LAUNCH_PIN level that holds the launch limit. 0 is a switch to ground
+#endif
+
+/** Knock, with a KNOCK_PIN */
+#ifndef KNOCK_CYLINDERS
+#define KNOCK_CYLINDERS 1
+#endif
+#ifndef KNOCK_FREQUENCY_HZ
+#define KNOCK_FREQUENCY_HZ 7000
+#endif
+#ifndef KNOCK_WINDOW_START_DEGREES
+#define KNOCK_WINDOW_START_DEGREES 10.0f
+#endif
+#ifndef KNOCK_WINDOW_END_DEGREES
+#define KNOCK_WINDOW_END_DEGREES 60.0f
+#endif
+#ifndef KNOCK_THRESHOLD_Q4
+#define KNOCK_THRESHOLD_Q4 48 // 3x the noise floor
+#endif
+
+#ifndef CALIBRATION_RPM_MIN
+#define CALIBRATION_RPM_MIN 1000
+#endif
+#ifndef CALIBRATION_RPM_MAX
+#define CALIBRATION_RPM_MAX 12000
+#endif
+
+/** Fuel */
+#ifndef INJ_REQ_FUEL_US
+#define INJ_REQ_FUEL_US 6000
+#endif
+#ifndef INJ_SOI_DEGREES
+#define INJ_SOI_DEGREES 360.0f
+#endif
+#ifndef INJ_RPM_MAX
+#define INJ_RPM_MAX 12000
+#endif
+
+/** Traction control */
+#ifndef TC_DRIVEN_SCALE
+#define TC_DRIVEN_SCALE 1.0f // Same tone wheels and tires front and rear
+#endif
+#ifndef TC_SLIP_TARGET
+#define TC_SLIP_TARGET 8.0f
+#endif
+#ifndef TC_SLIP_CUT
+#define TC_SLIP_CUT 20.0f
+#endif
+#ifndef TC_MAX_RETARD_DEGREES
+#define TC_MAX_RETARD_DEGREES 10
+#endif
+#ifndef TC_MIN_SPEED_HZ
+#define TC_MIN_SPEED_HZ 5.0f
+#endif
+
+/** Sensors and tuning */
+#ifndef SENSOR_POLL_PERIOD
+#define SENSOR_POLL_PERIOD 100000
+#endif
+#ifndef TUNE_RPM_MAX
+#define TUNE_RPM_MAX 15000
+#endif
+#ifndef CYCLE_COUNT
+#define CYCLE_COUNT 0 // Count the cycles each callback takes, for TUNE_CYCLES. 1 to enable
+#endif
+
+#if TRIGGERS_PER_REVOLUTION < 1
+#error "TRIGGERS_PER_REVOLUTION must be at least 1"
+#endif
+
+#ifdef CAM_PIN
+#if 360 % TRIGGERS_PER_REVOLUTION || 720 % ENGINE_CYLINDERS
+#error "Cam sync needs TRIGGERS_PER_REVOLUTION to divide 360 and ENGINE_CYLINDERS to divide 720"
+#endif
+#if CAM_SYNC_EDGE >= 2 * TRIGGERS_PER_REVOLUTION
+#error "CAM_SYNC_EDGE must be less than the 2 * TRIGGERS_PER_REVOLUTION edges in an engine cycle"
+#endif
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <pico/stdlib.h>
+#include <hardware/structs/systick.h>
+#include "cycles.h"
+
+/** SysTick is 24 bits */
+#define CYCLES_MASK 0xffffff
+/** Enabled, no interrupt, counting processor clock cycles */
+#define CYCLES_CSR 0x5
+
+static cycles_stats_t cycles_stats[NUM_CORES][CYCLES_SLOTS];
+
+void cycles_init() {
+  systick_hw->csr = 0;
+  systick_hw->rvr = CYCLES_MASK;
+  systick_hw->cvr = 0;
+  systick_hw->csr = CYCLES_CSR;
+}
+
+void cycles_record(const void* what, uint32_t start) {
+  // Counts down
+  uint32_t cycles = (start - cycles_now()) & CYCLES_MASK;
+  cycles_stats_t* stats = cycles_stats[get_core_num()];
+
+  for (uint8_t i = 0; i < CYCLES_SLOTS; ++i) {
+    if (stats[i].what && stats[i].what != what) continue;
+    stats[i].what = what;
+    stats[i].calls++;
+    stats[i].total += cycles;
+    stats[i].max = MAX(stats[i].max, cycles);
+    return;
+  }
+}
+
+const cycles_stats_t* cycles_get(uint core, uint8_t slot) {
+  if (core >= NUM_CORES || slot >= CYCLES_SLOTS || !cycles_stats[core][slot].what) {
+    return NULL;
+  }
+  return &cycles_stats[core][slot];
+}
@@ -0,0 +1,53 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include <pico/stdlib.h>
+#include <hardware/structs/systick.h>
+#include "config.h"
+
+/**
+ * On-target cost of the hot path callbacks, in CPU cycles. Only wired in with CYCLE_COUNT (the
+ * bench profile), and read out with TUNE_CYCLES.
+ *
+ * Each core's SysTick counts down at the system clock and wraps every 2^24 cycles, 134ms at
+ * 125MHz, far longer than any callback. Every scheduler alarm callback (rescheduling included)
+ * and the trigger's edge IRQ (listeners included) is counted under its own address. Look the
+ * addresses up in the .dis.
+ */
+#define CYCLES_SLOTS 8
+
+typedef struct cycles_stats {
+  const void* what;
+  uint32_t calls;
+  uint64_t total;
+  uint32_t max;
+} cycles_stats_t;
+
+/**
+ * Start the calling core's SysTick. Call once from each core.
+ */
+void cycles_init();
+
+static inline uint32_t cycles_now() {
+  return systick_hw->cvr;
+}
+
+/**
+ * Count the cycles since `start`, a `cycles_now()`, against `what`. Slots are taken in the order
+ * callbacks first run. Once they're all taken, new callbacks aren't counted.
+ */
+void cycles_record(const void* what, uint32_t start);
+
+/**
+ * A core's counts for one callback, or NULL past the last one seen. Read from either core: a
+ * count can be torn by a callback on the other core, which is fine for a benchmark.
+ */
+const cycles_stats_t* cycles_get(uint core, uint8_t slot);
+
+#endif
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+"""
+Flash stall audit for the DEJA_RAM_HOT_PATH (copy_to_ram) image.
+
+Reads the section table and disassembly written by `pico_add_extra_outputs` (<target>.dis)
+and checks two things:
+
+- Only the boot sections stay in flash. The copy_to_ram linker script leaves the boot stage,
+  the unwind tables, binary info and anything marked `__in_flash` there, and copies the rest
+  to SRAM. Any other section in flash means the image isn't the RAM build it's meant to be.
+- Nothing reachable from the root functions calls into flash or keeps a flash address in its
+  literal pool, so it can't execute or read from XIP while a flash write has it disabled.
+
+Calls through function pointers can't be followed, so every callback is a root. Rather than
+being listed by hand, the roots are found in the firmware's own sources: every function that's
+used other than by calling it, so passed to the scheduler, the state store, the alarm pool or
+an IRQ registration. Functions that only ever run at init, like core1's entry point, are left
+out with --exclude. More can be added with --root.
+
+usage: flash_audit.py <target>.dis [--exclude name ...] [--root name ...]
+                      [--boot-section name ...] source.c [source.c ...]
+"""
+
+import argparse
+import re
+import sys
+
+# The four XIP aliases of flash: cached, no-allocate, uncached and both
+FLASH_START = 0x10000000
+FLASH_END = 0x14000000
+
+# What memmap_copy_to_ram.ld keeps in flash. `.rodata` there only holds `__in_flash` data.
+BOOT_SECTIONS = {".flash_begin", ".boot2", ".flashtext", ".rodata", ".ARM.extab", ".ARM.exidx",
+                 ".binary_info", ".flash_end"}
+
+# objdump -h: index, name, size, VMA, LMA, file offset, alignment. Flags on the next line.
+SECTION_RE = re.compile(r"^\s*\d+\s+(\S+)\s+([0-9a-f]{8})\s+([0-9a-f]{8})\s+[0-9a-f]{8}\s")
+FUNCTION_RE = re.compile(r"^([0-9a-f]{8}) <([^>]+)>:$")
+# Direct calls and tail calls into the start of another function
+CALL_RE = re.compile(r"\s(?:bl|blx|b|b\.n|b\.w)\s+([0-9a-f]+) <([^>+]+)>")
+# Literal pool entries, which is where the addresses a function loads from live
+WORD_RE = re.compile(r"\s\.word\s+0x([0-9a-f]{8})")
+# A function definition's name, at the start of a line
+DEFINITION_RE = re.compile(r"^[A-Za-z_][\w \t*]*?\b(\w+)\s*\([^;{)]*\)\s*\{", re.M)
+# Section placement macros wrap the name: __not_in_flash_func(name)(...)
+PLACEMENT_RE = re.compile(r"\b__(?:not_in_flash|time_critical)_func\((\w+)\)")
+
+
+def strip_source(text):
+  """Comments and string literals out, and placement macros unwrapped"""
+  text = re.sub(r"/\*.*?\*/", " ", text, flags=re.S)
+  text = re.sub(r"//[^\n]*", " ", text)
+  text = re.sub(r'"(?:\\.|[^"\\])*"', '""', text)
+  text = re.sub(r"'(?:\\.|[^'\\])*'", "''", text)
+  return PLACEMENT_RE.sub(r"\1", text)
+
+
+def callbacks(paths):
+  """Functions defined in `paths` whose address is taken anywhere in them"""
+  texts = []
+  for path in paths:
+    with open(path) as source:
+      texts.append(strip_source(source.read()))
+
+  defined = set()
+  for text in texts:
+    defined.update(DEFINITION_RE.findall(text))
+
+  taken = set()
+  for name in defined:
+    used = re.compile(r"\b%s\b(?!\s*\()" % re.escape(name))
+    if any(used.search(text) for text in texts):
+      taken.add(name)
+  return taken
+
+
+def parse(path):
+  """Allocated sections with their VMAs, function addresses, calls, and literal pool words"""
+  sections = {}
+  functions = {}
+  calls = {}
+  words = {}
+  current = None
+  section = None
+  with open(path) as dis:
+    for line in dis:
+      match = SECTION_RE.match(line)
+      if match:
+        section = (match.group(1), int(match.group(2), 16), int(match.group(3), 16))
+        continue
+      if section is not None:
+        name, size, vma = section
+        if "ALLOC" in line and size:
+          sections[name] = vma
+        section = None
+        continue
+
+      match = FUNCTION_RE.match(line.strip())
+      if match:
+        current = match.group(2)
+        functions[current] = int(match.group(1), 16)
+        calls.setdefault(current, set())
+        words.setdefault(current, set())
+        continue
+      if current is None:
+        continue
+      match = CALL_RE.search(line)
+      if match and match.group(2) != current:
+        calls[current].add(match.group(2))
+      match = WORD_RE.search(line)
+      if match:
+        words[current].add(int(match.group(1), 16))
+  return sections, functions, calls, words
+
+
+def resolve(name, functions):
+  """Static functions may have been cloned by the optimizer (foo.isra.0, foo.constprop.0)"""
+  if name in functions:
+    return [name]
+  return [f for f in functions if f.startswith(name + ".")]
+
+
+def in_flash(address):
+  return FLASH_START <= address < FLASH_END
+
+
+def chain(name, reached_from):
+  """How the walk got to `name`, back to its root"""
+  path = [name]
+  while reached_from[path[-1]] is not None:
+    path.append(reached_from[path[-1]])
+  return " <- ".join(path[1:]) or "root"
+
+
+def main(argv):
+  parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+  parser.add_argument("dis", help="<target>.dis")
+  parser.add_argument("sources", nargs="+", help="firmware sources to find the callbacks in")
+  parser.add_argument("--exclude", action="append", default=[], metavar="name",
+                      help="callback that only runs at init")
+  parser.add_argument("--root", action="append", default=[], metavar="name",
+                      help="extra root")
+  parser.add_argument("--boot-section", action="append", default=[], metavar="name",
+                      help="extra section allowed to stay in flash")
+  args = parser.parse_args(argv[1:])
+
+  sections, functions, calls, words = parse(args.dis)
+  if not sections:
+    print("error: no section table in %s" % args.dis)
+    return 1
+
+  boot = BOOT_SECTIONS | set(args.boot_section)
+  stray = sorted(name for name, vma in sections.items() if in_flash(vma) and name not in boot)
+  for name in stray:
+    print("flash: section %s (0x%08x) isn't copied to RAM" % (name, sections[name]))
+  roots = sorted((callbacks(args.sources) | set(args.root)) - set(args.exclude))
+
+  # name -> the function that first reached it, for reporting the path
+  reached_from = {}
+  pending = []
+  for root in roots:
+    names = resolve(root, functions)
+    if not names:
+      print("warning: root %s not found (not linked in this build)" % root)
+    for name in names:
+      reached_from[name] = None
+      pending.append(name)
+
+  while pending:
+    name = pending.pop()
+    for callee in calls.get(name, ()):
+      if callee in functions and callee not in reached_from:
+        reached_from[callee] = name
+        pending.append(callee)
+
+  offenders = sorted(f for f in reached_from if in_flash(functions[f]))
+  readers = sorted(f for f in reached_from if any(in_flash(word) for word in words.get(f, ())))
+  for name in offenders:
+    print("flash: %s (0x%08x) via %s" % (name, functions[name], chain(name, reached_from)))
+  for name in readers:
+    addresses = ", ".join("0x%08x" % word for word in sorted(words[name]) if in_flash(word))
+    print("flash: %s refers to %s via %s" % (name, addresses, chain(name, reached_from)))
+
+  print("%d functions reachable from %d roots, %d in flash, %d referring to flash, %d stray sections"
+        % (len(reached_from), len(roots), len(offenders), len(readers), len(stray)))
+  return 1 if offenders or readers or stray else 0
+
+
+if __name__ == "__main__":
+  sys.exit(main(sys.argv))
@@ -0,0 +1,57 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <pico/stdlib.h>
+#include <pico/sync.h>
+#include "idle.h"
+#include "tick.h"
+
+typedef struct idle_stats {
+  tick_t window_start;
+  uint32_t idle_us;
+  volatile uint16_t load;
+  volatile uint16_t peak;
+} idle_stats_t;
+
+static idle_stats_t idle_stats[NUM_CORES];
+
+void idle_init() {
+  idle_stats_t* stats = &idle_stats[get_core_num()];
+  stats->window_start = tick_now();
+  stats->idle_us = 0;
+  stats->load = 0;
+  stats->peak = 0;
+}
+
+void idle_wait() {
+  idle_stats_t* stats = &idle_stats[get_core_num()];
+
+  // WFI still wakes on a masked interrupt, but the handler only runs once they're restored.
+  // That keeps handler time out of the idle time. WFE isn't needed: every wake source we
+  // have is an interrupt, and it would also wake on the other core's spin-lock SEVs.
+  uint32_t interrupts = save_and_disable_interrupts();
+  tick_t sleep = tick_now();
+  __wfi();
+  tick_t wake = tick_now();
+
+  stats->idle_us += tick_diff(wake, sleep);
+  uint32_t elapsed = tick_diff(wake, stats->window_start);
+  if (elapsed >= IDLE_WINDOW_US) {
+    stats->load = 1000 - (uint64_t) MIN(stats->idle_us, elapsed) * 1000 / elapsed;
+    stats->peak = MAX(stats->peak, stats->load);
+    stats->window_start = wake;
+    stats->idle_us = 0;
+  }
+  restore_interrupts(interrupts);
+}
+
+uint16_t idle_load(uint core) {
+  return idle_stats[core].load;
+}
+
+uint16_t idle_peak_load(uint core) {
+  return idle_stats[core].peak;
+}
@@ -0,0 +1,37 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <pico/stdlib.h>
+
+/** Length of the window the load is averaged over */
+#define IDLE_WINDOW_US 100000
+
+/**
+ * Start measuring the calling core's load. Call once from each core before its idle loop.
+ */
+void idle_init();
+
+/**
+ * Sleep the calling core until an interrupt is pending: a scheduler alarm, a GPIO edge, the
+ * doorbell FIFO or USB. Returns after the interrupt has been handled. Time spent asleep counts
+ * as idle, everything else (handlers included) as busy.
+ */
+void idle_wait();
+
+/**
+ * A core's busy time over the last complete window, in tenths of a percent
+ */
+uint16_t idle_load(uint core);
+
+/**
+ * Highest `idle_load` seen since `idle_init`. Rev it to redline to see how much headroom is left.
+ */
+uint16_t idle_peak_load(uint core);
+
+#endif
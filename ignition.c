@@ -7,58 +7,187 @@
 #include <pico/stdlib.h>
 #include <hardware/gpio.h>
 #include "ignition.h"
+#include "arena.h"
 #include "state.h"
 #include "timing.h"
 #include "scheduler.h"
+#include "limiter.h"
+#include "knock.h"
+#include "traction.h"
 
 #define SCHEDULE_DWELL 0
 
 struct ignition {
-  uint8_t coil_pin;
-  uint8_t indicator_pin;
-  uint64_t dwell_us;
-  uint64_t timing_light_pulse_us;
   alarm_pool_t* alarm_pool;
   timing_func_t get_timing;
+  dwell_func_t get_dwell;
+  Limiter_t limiter;
+  Knock_t knock;
+  Traction_t traction;
+  StateStore_t store;
+  engine_clock_t crank_clock;
+  // Double buffered like the state: written by the trigger core, read by the spark core
+  ignition_plan_t plans[2];
+  volatile bool plan_index;
+  // Copy of the plan currently being executed
+  ignition_plan_t armed;
+  // Written by the spark core, read by the plan listener
+  volatile uint32_t misses;
+  volatile uint32_t short_dwells;
+  uint32_t window_misses;
+  uint8_t window_cycles;
+  bool degraded;
 };
 
-Ignition_t ignition_init(
-  uint8_t coil_pin,
-  uint8_t indicator_pin,
-  uint64_t dwell_us,
-  uint64_t timing_light_pulse_us,
-  timing_func_t get_timing
-) {
-  Ignition_t ign = malloc(sizeof(struct ignition));
-  ign->coil_pin = coil_pin;
-  ign->indicator_pin = indicator_pin;
-  ign->dwell_us = dwell_us;
-  ign->timing_light_pulse_us = timing_light_pulse_us;
+Ignition_t ignition_init(timing_func_t get_timing) {
+  Ignition_t ign = arena_alloc(sizeof(struct ignition));
   ign->get_timing = get_timing;
+  ign->get_dwell = NULL;
+  ign->limiter = NULL;
+  ign->knock = NULL;
+  ign->traction = NULL;
+  ign->store = state_default_store();
+  ign->crank_clock = 0;
+  ign->plan_index = 0;
+  ign->plans[0].cut = true;
+  ign->plans[1].cut = true;
+  ign->armed = ign->plans[0];
+  ign->misses = 0;
+  ign->short_dwells = 0;
+  ign->window_misses = 0;
+  ign->window_cycles = 0;
+  ign->degraded = false;
   ignition_init_io(ign);
 
   return ign;
 }
 
 void ignition_init_io(Ignition_t ign) {
-  gpio_init(ign->indicator_pin);
-  gpio_init(ign->coil_pin);
-  gpio_set_dir(ign->indicator_pin, GPIO_OUT);
-  gpio_set_dir(ign->coil_pin, GPIO_OUT);
+  gpio_init(IGN_COIL_PIN);
+  gpio_set_dir(IGN_COIL_PIN, GPIO_OUT);
+#if !IGN_TIMING_LIGHT_PULSE_US
+  // No strobe to drive the timing light, so hold it off rather than leave it floating
+  gpio_init(IGN_TIMING_LIGHT_PIN);
+  gpio_set_dir(IGN_TIMING_LIGHT_PIN, GPIO_OUT);
+  gpio_put(IGN_TIMING_LIGHT_PIN, 0);
+#endif
 }
 
+static void ignition_crank_event(Ignition_t ign, event_t* event, State_t* state);
+static void ignition_dwell_event_callback(event_t* event);
+static void ignition_arm(Ignition_t ign, event_t* event);
+
+/**
+ * Start of dwell. The spark time was precomputed, so just flip the pin and arm it.
+ */
+static void ignition_dwell_start_callback(event_t* event) {
+  Ignition_t ign = event->param;
+
+  // Running late eats into the dwell, never into the spark angle
+  tick_diff_t dwell_us = tick_diff(ign->armed.spark, tick_now());
+  if (dwell_us < (tick_diff_t) MIN(IGN_MIN_DWELL_US, ign->armed.dwell_us / 2)) {
+    // Not enough time left to charge the coil. Skip this one
+    ++ign->misses;
+    ignition_arm(ign, event);
+    return;
+  }
+  if (dwell_us < (tick_diff_t) ign->armed.dwell_us - IGN_SPARK_LATE_US) {
+    ++ign->short_dwells;
+  }
+
+  gpio_put(IGN_COIL_PIN, 1);
+
+  event->mode = ABSOLUTE_US;
+  event->what = ignition_dwell_event_callback;
+  event->when.us = ign->armed.spark;
+}
+
+/**
+ * Arm the dwell start of the newest plan. If the trigger hasn't published one since the last
+ * spark, wait for the engine clock to move on and look again.
+ */
+static void ignition_arm(Ignition_t ign, event_t* event) {
+  ignition_plan_t* plan = &ign->plans[ign->plan_index];
+
+  if (plan->clock != ign->armed.clock && !plan->cut) {
+    ign->armed = *plan;
+    event->mode = ABSOLUTE_US;
+    event->what = ignition_dwell_start_callback;
+    event->when.us = ign->armed.dwell_start;
+    return;
+  }
+
+  // Slow path: no fresh plan. Either the limiter cut it, it is a waste TDC, or the engine stopped
+  // or is cranking.
+  State_t state = state_store_get(ign->store);
+  if (!state.running || state.cranking) {
+    ignition_crank_event(ign, event, &state);
+    return;
+  }
+
+  ign->armed = *plan;
+  event->mode = WAIT_CYCLE;
+  event->what = ignition_event_callback;
+}
+
+/**
+ * End of dwell
+ */
 static void ignition_dwell_event_callback(event_t* event) {
   Ignition_t ign = event->param;
-  State_t state = state_get();
 
   // ~~ Zap! ~~
-  gpio_put(ign->coil_pin, 0);
+  gpio_put(IGN_COIL_PIN, 0);
 
-  // Schedule start of next dwell at `dwell_us` prior to the desired timing in the following engine cycle
-  event->mode = NEXT_CYCLE;
-  event->what = ignition_event_callback;
-  event->when.degrees = ign->get_timing(&state);
-  event->when.us = -ign->dwell_us;
+  // The coil can't be held, so a late spark still happens. Count it
+  if (tick_diff(tick_now(), ign->armed.spark) > IGN_SPARK_LATE_US) {
+    ++ign->misses;
+  }
+
+  ignition_arm(ign, event);
+}
+
+/**
+ * End of a cranking dwell. Hands over to predictive timing once the trigger has seen
+ * enough stable periods.
+ */
+static void ignition_crank_spark_callback(event_t* event) {
+  Ignition_t ign = event->param;
+  State_t state = state_store_get(ign->store);
+
+  // ~~ Zap! ~~
+  gpio_put(IGN_COIL_PIN, 0);
+
+  if (state.running && !state.cranking) {
+    ignition_arm(ign, event);
+  } else {
+    ignition_crank_event(ign, event, &state);
+  }
+}
+
+/**
+ * Cranking mode. There's no period worth predicting from yet, so poll for the next trigger
+ * edge and fire straight off of it: dwell starts on the edge and the spark follows IGN_DWELL_US later.
+ */
+static void ignition_crank_event(Ignition_t ign, event_t* event, State_t* state) {
+  if (!state->running) {
+    ign->crank_clock = state->clock;
+  }
+
+  if (state->running && state->clock != ign->crank_clock) {
+    // New trigger edge. Begin dwell right away
+    ign->crank_clock = state->clock;
+    gpio_put(IGN_COIL_PIN, 1);
+
+    event->mode = RELATIVE_US;
+    event->what = ignition_crank_spark_callback;
+    event->when.us = IGN_DWELL_US;
+
+  } else {
+    event->mode = RELATIVE_US;
+    event->what = ignition_event_callback;
+    event->when.us = IGN_CRANK_POLL_US;
+  }
 }
 
 /**
@@ -69,27 +198,129 @@ static void ignition_dwell_event_callback(event_t* event) {
  * 
  * */
 void ignition_event_callback(event_t* event) {
-  Ignition_t ign = event->param;
-  State_t state = state_get();
-  if (state.running) {
-    // Begin dwell period
-    gpio_put(ign->coil_pin, 1);
+  ignition_arm(event->param, event);
+}
+
+/**
+ * Whether the coming TDC is one the spark can be skipped at: with the cam synced, only every
+ * (720 / ENGINE_CYLINDERS) degrees is a compression TDC. Without it, every TDC gets a spark.
+ */
+static inline bool ignition_waste_tdc(State_t* state) {
+#ifdef CAM_PIN
+  return state->cam_synced && state->phase % (720 / ENGINE_CYLINDERS);
+#else
+  return false;
+#endif
+}
+
+/**
+ * Once per window, look at how many sparks the spark path has missed and switch the fallback
+ * timing on or off.
+ */
+static inline void ignition_check_deadlines(Ignition_t ign) {
+  if (++ign->window_cycles < IGN_MISS_WINDOW_CYCLES) {
+    return;
+  }
+  uint32_t misses = ign->misses;
+  uint32_t window_misses = misses - ign->window_misses;
+  ign->window_misses = misses;
+  ign->window_cycles = 0;
+
+  if (window_misses >= IGN_MISS_DEGRADE) {
+    ign->degraded = true;
+  } else if (window_misses == 0) {
+    ign->degraded = false;
+  }
+}
+
+void ignition_plan_listener(State_t* state, void* param) {
+  Ignition_t ign = param;
+  ignition_plan_t* plan = &ign->plans[!ign->plan_index];
+  plan->clock = state->clock;
+
+  if (!state->running) {
+    // Every run starts out on the full timing
+    ign->degraded = false;
+    ign->window_cycles = 0;
+    ign->window_misses = ign->misses;
+  }
+
+  if (!state->running || state->cranking || ignition_waste_tdc(state)) {
+    // Nothing to predict from, or nothing to light. Make sure a stale plan never gets armed
+    plan->cut = true;
+    plan->advance = 0;
+    plan->dwell_us = 0;
+    plan->degraded = ign->degraded;
+    ign->plan_index = !ign->plan_index;
+    return;
+  }
 
-    // Schedule spark (end of dwell period) for the desired timing in the present engine cycle
-    event->mode = SAME_CYCLE;
-    event->what = ignition_dwell_event_callback;
-    event->when.degrees = ign->get_timing(&state);
-    event->when.us = 0;
+  ignition_check_deadlines(ign);
 
+  limiter_action_t action = { .cut = false, .retard_degrees = 0 };
+  if (ign->limiter) {
+    action = limiter_evaluate(ign->limiter, state);
+  }
+
+  // A lookup, and knock doesn't stop for a struggling spark path, so it's kept either way
+  float knock_retard = ign->knock ? knock_get_retard(ign->knock, state) : 0;
+  float advance;
+  if (ign->degraded) {
+    // Cheapest plan there is: fixed timing and dwell, and only the limiter and knock for safety
+    advance = IGN_FALLBACK_ADVANCE - action.retard_degrees - knock_retard;
+    plan->dwell_us = IGN_DWELL_US;
   } else {
-    // If the engine is stopped, go back to starting mode
-    event->mode = NEXT_CYCLE;
-    event->what = ignition_event_callback;
-    event->when.degrees = TIMING_STATIC_VALUE;
-    event->when.us = -ign->dwell_us;
+    if (ign->traction) {
+      limiter_action_t traction = traction_evaluate(ign->traction);
+      action.cut |= traction.cut;
+      action.retard_degrees += traction.retard_degrees;
+    }
+    advance = ign->get_timing(state) - action.retard_degrees - knock_retard;
+    plan->dwell_us = ign->get_dwell ? ign->get_dwell(state) : IGN_DWELL_US;
   }
+
+  plan->cut = action.cut;
+  plan->advance = advance;
+  plan->degraded = ign->degraded;
+  plan->spark = state->next_tdc - (tick_diff_t) (advance * state->physical_period / 360.f);
+  plan->dwell_start = plan->spark - plan->dwell_us;
+
+  // Publish
+  ign->plan_index = !ign->plan_index;
+}
+
+const ignition_plan_t* ignition_get_plan(Ignition_t ign) {
+  return &ign->plans[ign->plan_index];
+}
+
+uint32_t ignition_misses(Ignition_t ign) {
+  return ign->misses;
+}
+
+uint32_t ignition_short_dwells(Ignition_t ign) {
+  return ign->short_dwells;
 }
 
 void ignition_set_timing_func(Ignition_t ign, timing_func_t get_timing) {
   ign->get_timing = get_timing;
 }
+
+void ignition_set_dwell_func(Ignition_t ign, dwell_func_t get_dwell) {
+  ign->get_dwell = get_dwell;
+}
+
+void ignition_set_limiter(Ignition_t ign, Limiter_t limiter) {
+  ign->limiter = limiter;
+}
+
+void ignition_set_knock(Ignition_t ign, Knock_t knock) {
+  ign->knock = knock;
+}
+
+void ignition_set_traction(Ignition_t ign, Traction_t traction) {
+  ign->traction = traction;
+}
+
+void ignition_set_state_store(Ignition_t ign, StateStore_t store) {
+  ign->store = store;
+}
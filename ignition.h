@@ -10,23 +10,51 @@
 #include <pico/stdlib.h>
 #include <pico/time.h>
 #include <hardware/gpio.h>
+#include "config.h"
 #include "state.h"
 #include "timing.h"
 #include "scheduler.h"
+#include "limiter.h"
+#include "knock.h"
+#include "traction.h"
+#include "tick.h"
+
+/** How often to look for a trigger edge while cranking */
+#define IGN_CRANK_POLL_US 50
+/**
+ * Shortest dwell worth charging the coil for, or half the planned dwell if that's shorter.
+ * A dwell start any later skips the spark.
+ */
+#define IGN_MIN_DWELL_US 500
+/** A spark this much later than planned is off angle, and counts as a miss */
+#define IGN_SPARK_LATE_US 50
+/** Cycles the miss rate is measured over */
+#define IGN_MISS_WINDOW_CYCLES 32
+/** Misses in one window that switch to fixed timing. A window without any switches back */
+#define IGN_MISS_DEGRADE 4
 
 typedef struct ignition* Ignition_t;
 
 /**
- * Construct a new ignition instance
+ * Everything the spark path needs for one cycle, worked out ahead of time by the trigger stage
  */
-Ignition_t ignition_init(
-  uint8_t coil_pin,
-  uint8_t indicator_pin,
-  uint64_t dwell_us,
-  uint64_t timing_light_pulse_us,
-  timing_func_t get_timing
-  // alarm_pool_t* alarm_pool
-);
+typedef struct ignition_plan {
+  engine_clock_t clock;
+  bool cut;
+  /** Final advance in degrees, after limiter and knock retard */
+  float advance;
+  uint32_t dwell_us;
+  tick_t dwell_start;
+  tick_t spark;
+  /** Planned at IGN_FALLBACK_ADVANCE because the spark path has been missing its deadlines */
+  bool degraded;
+} ignition_plan_t;
+
+/**
+ * Construct a new ignition instance. Fires the profile's IGN_COIL_PIN, with IGN_DWELL_US of
+ * dwell unless a dwell function is set.
+ */
+Ignition_t ignition_init(timing_func_t get_timing);
 
 /**
  * Set up GPIO for the ignition output(s)
@@ -34,16 +62,75 @@ Ignition_t ignition_init(
 void ignition_init_io(Ignition_t ign);
 
 /**
- * Callback for the scheduler. Ignition logic lives here.
- * If the enging is running, this will begin a pulse to the ignition coil, initiating the dwell period.
- * The dwell period is then ended by a second callback, which is scheduled based provided timing function.
- * The second callback then reschedules `ignition_event_callback` for the following cycle.
+ * Callback for the scheduler. Entry point of the spark path.
+ * If the engine is running, this arms the dwell start of the latest plan published by
+ * `ignition_plan_listener`. The dwell start flips the coil on and arms the precomputed spark,
+ * and the spark (`ignition_dwell_event_callback`) flips it off and arms the next plan.
+ * None of these do any timing math. While the engine is stopped or cranking, sparks are fired
+ * directly off the trigger edge instead.
+ * A dwell start that runs late charges for less time but still sparks on the planned time. If
+ * that leaves too little to charge the coil (IGN_MIN_DWELL_US), the spark is skipped rather
+ * than fired off angle.
  */
 void ignition_event_callback(event_t* event);
 
+/**
+ * State listener. Computes advance, dwell and the absolute spark and dwell start times for the
+ * cycle the trigger just measured, off of the spark path. Register with `state_add_listener`.
+ * Once the cam is synced, exhaust stroke TDCs get a cut plan instead (sequential spark).
+ * After IGN_MISS_DEGRADE misses in IGN_MISS_WINDOW_CYCLES, plans drop to IGN_FALLBACK_ADVANCE
+ * and fixed dwell, with only the limiter and knock retard applied, until a window goes by
+ * without a miss. That sheds the timing and dwell maps and traction control, all of it on core0:
+ * core1's spark path never did any math to shed. What it buys core1 is its plan, and the doorbell
+ * behind it, sooner after the trigger edge, which is what a late dwell start was waiting on.
+ */
+void ignition_plan_listener(State_t* state, void* param);
+
+/**
+ * The most recently published plan. Valid until the next clock change, so read it from a state
+ * listener registered after `ignition_plan_listener`.
+ */
+const ignition_plan_t* ignition_get_plan(Ignition_t ign);
+
+/**
+ * Sparks skipped or fired late since init
+ */
+uint32_t ignition_misses(Ignition_t ign);
+
+/**
+ * Sparks whose dwell was cut short by a late start, but still fired on time
+ */
+uint32_t ignition_short_dwells(Ignition_t ign);
+
 /**
  * Setter for the timing function. Feel free to call in flight.
  */
 void ignition_set_timing_func(Ignition_t ign, timing_func_t get_timing);
 
+/**
+ * Setter for the dwell function. NULL to use the profile's IGN_DWELL_US. Feel free to call in flight.
+ */
+void ignition_set_dwell_func(Ignition_t ign, dwell_func_t get_dwell);
+
+/**
+ * Attach a rev limiter to the spark path. NULL to disable.
+ */
+void ignition_set_limiter(Ignition_t ign, Limiter_t limiter);
+
+/**
+ * Attach a knock detector. Its per-cylinder retard is subtracted from the timing. NULL to disable.
+ */
+void ignition_set_knock(Ignition_t ign, Knock_t knock);
+
+/**
+ * Attach a traction control stage. Its retard and cuts add to the limiter's. NULL to disable.
+ */
+void ignition_set_traction(Ignition_t ign, Traction_t traction);
+
+/**
+ * Read from `store` instead of the state singleton. Register `ignition_plan_listener` on the
+ * same store.
+ */
+void ignition_set_state_store(Ignition_t ign, StateStore_t store);
+
 #endif
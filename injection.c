@@ -0,0 +1,168 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <pico/stdlib.h>
+#include <hardware/gpio.h>
+#include "injection.h"
+#include "arena.h"
+#include "state.h"
+#include "scheduler.h"
+
+/** Typical high-impedance injector dead times, 6V to 16V */
+static const uint16_t INJECTION_DEFAULT_DEAD_TIME_US[INJECTION_DEAD_TIME_BINS] = {
+  1500, 1100, 850, 700, 600, 520
+};
+
+struct injector {
+  Injection_t injection;
+  uint8_t pin;
+  /** Start of injection, in degrees before cylinder 1's compression TDC */
+  float degrees;
+};
+
+struct injection {
+  uint16_t req_fuel_us;
+  float soi_degrees;
+  uint16_t rpm_step;
+  uint8_t ve[INJECTION_RPM_BINS][INJECTION_LOAD_BINS];
+  uint16_t dead_time_us[INJECTION_DEAD_TIME_BINS];
+  struct injector injectors[INJECTION_MAX_INJECTORS];
+  uint8_t num_injectors;
+  // Written by the plan listener on the trigger core, read by the injector callbacks
+  volatile uint32_t pulse_width_us;
+};
+
+Injection_t injection_init(uint16_t req_fuel_us, float soi_degrees, uint16_t rpm_max) {
+  Injection_t inj = arena_alloc(sizeof(struct injection));
+  inj->req_fuel_us = req_fuel_us;
+  inj->soi_degrees = soi_degrees;
+  inj->rpm_step = MAX(rpm_max / (INJECTION_RPM_BINS - 1), 1);
+  inj->num_injectors = 0;
+  inj->pulse_width_us = 0;
+
+  // Flat 80% until someone tunes it
+  for (uint8_t r = 0; r < INJECTION_RPM_BINS; ++r) {
+    for (uint8_t l = 0; l < INJECTION_LOAD_BINS; ++l) {
+      inj->ve[r][l] = 80;
+    }
+  }
+  for (uint8_t i = 0; i < INJECTION_DEAD_TIME_BINS; ++i) {
+    inj->dead_time_us[i] = INJECTION_DEFAULT_DEAD_TIME_US[i];
+  }
+
+  return inj;
+}
+
+Injector_t injection_add_injector(Injection_t inj, uint8_t pin, float phase_degrees) {
+  assert(inj->num_injectors < INJECTION_MAX_INJECTORS);
+  Injector_t injector = &inj->injectors[inj->num_injectors++];
+  injector->injection = inj;
+  injector->pin = pin;
+  injector->degrees = inj->soi_degrees - phase_degrees;
+
+  gpio_init(pin);
+  gpio_set_dir(pin, GPIO_OUT);
+  gpio_put(pin, 0);
+
+  return injector;
+}
+
+void injection_set_ve(Injection_t inj, uint8_t rpm_bin, uint8_t load_bin, uint8_t ve) {
+  if (rpm_bin >= INJECTION_RPM_BINS || load_bin >= INJECTION_LOAD_BINS) return;
+  inj->ve[rpm_bin][load_bin] = ve;
+}
+
+void injection_set_dead_time(Injection_t inj, uint8_t bin, uint16_t dead_time_us) {
+  if (bin >= INJECTION_DEAD_TIME_BINS) return;
+  inj->dead_time_us[bin] = dead_time_us;
+}
+
+/**
+ * Splits a Q8 axis position into a bin and a Q8 fraction, clamped so `bin + 1` is always valid
+ */
+static inline void injection_axis(uint32_t position_q8, uint8_t bins, uint8_t* bin, uint16_t* fraction) {
+  uint32_t max_q8 = (bins - 1) << 8;
+  if (position_q8 >= max_q8) {
+    *bin = bins - 2;
+    *fraction = 256;
+  } else {
+    *bin = position_q8 >> 8;
+    *fraction = position_q8 & 0xff;
+  }
+}
+
+/** Bilinear VE lookup, in Q8 percent */
+static uint32_t injection_ve(Injection_t inj, State_t* state) {
+  uint32_t rpm = state->physical_period ? 60000000u / state->physical_period : 0;
+  uint8_t r, l;
+  uint16_t rf, lf;
+  injection_axis((rpm << 8) / inj->rpm_step, INJECTION_RPM_BINS, &r, &rf);
+  injection_axis(((uint32_t) state->airflow * (INJECTION_LOAD_BINS - 1) << 8) / 255, INJECTION_LOAD_BINS, &l, &lf);
+
+  uint32_t low = inj->ve[r][l] * (256 - lf) + inj->ve[r][l + 1] * lf;
+  uint32_t high = inj->ve[r + 1][l] * (256 - lf) + inj->ve[r + 1][l + 1] * lf;
+
+  return (low * (256 - rf) + high * rf) >> 8;
+}
+
+static uint32_t injection_dead_time(Injection_t inj, State_t* state) {
+  uint32_t millivolts = MAX(state->battery_voltage, INJECTION_DEAD_TIME_MV_MIN) - INJECTION_DEAD_TIME_MV_MIN;
+  uint8_t bin;
+  uint16_t fraction;
+  injection_axis((millivolts << 8) / INJECTION_DEAD_TIME_MV_STEP, INJECTION_DEAD_TIME_BINS, &bin, &fraction);
+
+  return (inj->dead_time_us[bin] * (256 - fraction) + inj->dead_time_us[bin + 1] * fraction) >> 8;
+}
+
+uint32_t injection_pulse_width(Injection_t inj, State_t* state) {
+  if (state->airflow == 0) return 0;
+
+  // 16 bits of req_fuel by at most 16 bits of Q8 VE still fits in 32 bits, so no 64-bit division
+  uint32_t fuel_us = (uint32_t) inj->req_fuel_us * injection_ve(inj, state) / (100 * 256);
+  fuel_us = fuel_us * state->airflow / 255;
+  uint32_t pulse_width = fuel_us + injection_dead_time(inj, state);
+  uint32_t max_pulse_width = state->ignition_period * INJECTION_MAX_DUTY / 100;
+
+  return MIN(pulse_width, max_pulse_width);
+}
+
+void injection_plan_listener(State_t* state, void* param) {
+  Injection_t inj = param;
+  inj->pulse_width_us = state->running ? injection_pulse_width(inj, state) : 0;
+}
+
+static void injection_close_event_callback(event_t* event) {
+  Injector_t injector = event->param;
+
+  gpio_put(injector->pin, 0);
+
+  // Schedule the next start of injection in the following engine cycle
+  event->mode = NEXT_PHASE;
+  event->what = injection_event_callback;
+  event->when.degrees = injector->degrees;
+  event->when.us = 0;
+}
+
+void injection_event_callback(event_t* event) {
+  Injector_t injector = event->param;
+  uint32_t pulse_width = injector->injection->pulse_width_us;
+
+  if (pulse_width > 0) {
+    // Squirt
+    gpio_put(injector->pin, 1);
+
+    // Close the injector once the pulse width has elapsed
+    event->mode = RELATIVE_US;
+    event->what = injection_close_event_callback;
+    event->when.us = pulse_width;
+
+  } else {
+    event->mode = NEXT_PHASE;
+    event->what = injection_event_callback;
+    event->when.degrees = injector->degrees;
+    event->when.us = 0;
+  }
+}
@@ -0,0 +1,70 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef INJECTION_H
+#define INJECTION_H
+
+#include <pico/stdlib.h>
+#include "state.h"
+#include "scheduler.h"
+
+#define INJECTION_MAX_INJECTORS 2
+#define INJECTION_RPM_BINS 8
+#define INJECTION_LOAD_BINS 8
+#define INJECTION_DEAD_TIME_BINS 6
+#define INJECTION_DEAD_TIME_MV_MIN 6000
+#define INJECTION_DEAD_TIME_MV_STEP 2000
+/** Maximum injector duty cycle, in percent of the ignition period */
+#define INJECTION_MAX_DUTY 85
+
+typedef struct injection* Injection_t;
+typedef struct injector* Injector_t;
+
+/**
+ * Construct a new fuel injection instance.
+ * `req_fuel_us` is the pulse width at 100% VE and full load, excluding dead time.
+ * `soi_degrees` is the start of injection angle, in degrees before TDC.
+ * The VE map spans 0 to `rpm_max` on one axis and the full `state.airflow` range on the other.
+ */
+Injection_t injection_init(uint16_t req_fuel_us, float soi_degrees, uint16_t rpm_max);
+
+/**
+ * Add an injector on `pin`, injecting `phase_degrees` later than the start of injection angle.
+ * Its cylinder's compression TDC is `phase_degrees` after cylinder 1's.
+ * Schedule `injection_event_callback` in NEXT_PHASE mode at `INJ_SOI_DEGREES - phase_degrees`,
+ * with the returned injector as the event param. Once per engine cycle with the cam synced,
+ * batch injected on every TDC without.
+ */
+Injector_t injection_add_injector(Injection_t inj, uint8_t pin, float phase_degrees);
+
+/**
+ * State listener. Works out the pulse width for the coming cycle on the trigger core, so the
+ * injector callbacks only have to open and close the injector.
+ */
+void injection_plan_listener(State_t* state, void* param);
+
+/**
+ * Callback for the scheduler. Opens the injector at the start of injection angle, then closes
+ * it after the pulse width the plan listener left and reschedules itself for the following cycle.
+ */
+void injection_event_callback(event_t* event);
+
+/**
+ * Set a single cell of the VE map, in percent
+ */
+void injection_set_ve(Injection_t inj, uint8_t rpm_bin, uint8_t load_bin, uint8_t ve);
+
+/**
+ * Set the injector dead time at `INJECTION_DEAD_TIME_MV_MIN + bin * INJECTION_DEAD_TIME_MV_STEP`
+ */
+void injection_set_dead_time(Injection_t inj, uint8_t bin, uint16_t dead_time_us);
+
+/**
+ * Pulse width in µs for the given state, including dead time
+ */
+uint32_t injection_pulse_width(Injection_t inj, State_t* state);
+
+#endif
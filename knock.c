@@ -0,0 +1,218 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <math.h>
+#include <pico/stdlib.h>
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+#include "knock.h"
+#include "arena.h"
+#include "state.h"
+#include "scheduler.h"
+#include "helpers.h"
+
+#define ADC_CLOCK_HZ 48000000.f
+/**
+ * Samples are scaled down to 10 bits. On frequency the filter state grows by about
+ * amplitude / (2 sin(2πf/fs)) per sample, so 512 full scale samples at 7kHz reach ~2^18 and the
+ * state itself fits in 32 bits. Its product with the Q12 coefficient doesn't, so that's 64 bit.
+ */
+#define KNOCK_SAMPLE_SHIFT 2
+#define KNOCK_ENERGY_SHIFT 8
+/** Noise floor EMA weight, as a shift (1/16) */
+#define KNOCK_FLOOR_SHIFT 4
+
+struct knock {
+  uint8_t pin;
+  uint8_t cylinders;
+  uint dma_channel;
+  int32_t coeff_q12;
+  float window_start_degrees;
+  float window_end_degrees;
+  uint16_t threshold_q4;
+  bool sampling;
+  uint8_t window_cylinder;
+  volatile bool window_pending;
+  uint16_t window_count;
+  uint32_t noise_floor;
+  float retard[KNOCK_MAX_CYLINDERS];
+  uint16_t* samples;
+};
+
+/**
+ * DMA target for the one knock sensor. Kept in striped main SRAM rather than in the arena, so
+ * a window's worth of DMA writes doesn't land in core0's scratch bank, next to its stack.
+ */
+static uint16_t __attribute__((aligned(4))) knock_samples[KNOCK_MAX_SAMPLES];
+
+Knock_t knock_init(
+  uint8_t pin,
+  uint8_t cylinders,
+  uint16_t knock_frequency_hz,
+  float window_start_degrees,
+  float window_end_degrees,
+  uint16_t threshold_q4
+) {
+  Knock_t knock = arena_alloc(sizeof(struct knock));
+  knock->pin = pin;
+  knock->cylinders = MIN(MAX(cylinders, 1), KNOCK_MAX_CYLINDERS);
+  knock->coeff_q12 = 2.f * cosf(2.f * (float) M_PI * knock_frequency_hz / KNOCK_SAMPLE_RATE_HZ) * (1 << 12);
+  knock->window_start_degrees = window_start_degrees;
+  knock->window_end_degrees = window_end_degrees;
+  knock->threshold_q4 = threshold_q4;
+  knock->sampling = false;
+  knock->window_cylinder = 0;
+  knock->window_pending = false;
+  knock->window_count = 0;
+  knock->noise_floor = 0;
+  knock->samples = knock_samples;
+  for (uint8_t i = 0; i < KNOCK_MAX_CYLINDERS; ++i) {
+    knock->retard[i] = 0;
+  }
+
+  adc_gpio_init(pin);
+  knock->dma_channel = dma_claim_unused_channel(true);
+
+  return knock;
+}
+
+uint32_t knock_goertzel(const uint16_t* samples, uint16_t count, int32_t coeff_q12) {
+  if (count == 0) return 0;
+
+  // Remove DC so the filter only sees the vibration
+  uint32_t sum = 0;
+  for (uint16_t i = 0; i < count; ++i) {
+    sum += samples[i];
+  }
+  int32_t mean = sum / count;
+
+  int32_t s1 = 0;
+  int32_t s2 = 0;
+  for (uint16_t i = 0; i < count; ++i) {
+    int32_t x = ((int32_t) samples[i] - mean) >> KNOCK_SAMPLE_SHIFT;
+    int32_t s0 = x + (int32_t) (((int64_t) coeff_q12 * s1) >> 12) - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+
+  int64_t power = (int64_t) s1 * s1 + (int64_t) s2 * s2 - (((int64_t) coeff_q12 * s1) >> 12) * s2;
+  if (power <= 0) return 0;
+  power >>= KNOCK_ENERGY_SHIFT;
+
+  return power > UINT32_MAX ? UINT32_MAX : power;
+}
+
+static void knock_begin_sampling(Knock_t knock) {
+  adc_select_input(knock->pin - ADC_CHANNEL_OFFSET);
+  adc_fifo_setup(true, true, 1, false, false);
+  adc_set_clkdiv(ADC_CLOCK_HZ / KNOCK_SAMPLE_RATE_HZ - 1);
+
+  dma_channel_config config = dma_channel_get_default_config(knock->dma_channel);
+  channel_config_set_transfer_data_size(&config, DMA_SIZE_16);
+  channel_config_set_read_increment(&config, false);
+  channel_config_set_write_increment(&config, true);
+  channel_config_set_dreq(&config, DREQ_ADC);
+  dma_channel_configure(knock->dma_channel, &config, knock->samples, &adc_hw->fifo, KNOCK_MAX_SAMPLES, true);
+
+  knock->sampling = true;
+  adc_run(true);
+}
+
+/** Stops the ADC, hands it back to single-shot reads and returns the number of samples captured */
+static uint16_t knock_end_sampling(Knock_t knock) {
+  adc_run(false);
+  uint16_t count = KNOCK_MAX_SAMPLES - dma_channel_hw_addr(knock->dma_channel)->transfer_count;
+  dma_channel_abort(knock->dma_channel);
+  adc_fifo_drain();
+  adc_fifo_setup(false, false, 0, false, false);
+  adc_set_clkdiv(0);
+  knock->sampling = false;
+
+  return count;
+}
+
+/**
+ * Cylinder firing at `state`'s next TDC. Without cam sync the phase is only known within the
+ * revolution, so cylinders a revolution apart share a retard. Without a cam sensor there's no
+ * phase at all and every cylinder shares the first one's.
+ */
+static inline uint8_t knock_cylinder(Knock_t knock, const State_t* state) {
+  uint16_t phase = state->cam_synced ? state->phase : state->phase % 360;
+  return phase * knock->cylinders / 720;
+}
+
+void knock_update_retard(Knock_t knock, uint8_t cylinder, uint32_t energy) {
+  float* retard = &knock->retard[cylinder];
+
+  if (knock->noise_floor == 0) {
+    knock->noise_floor = energy;
+  }
+
+  if ((uint64_t) energy * 16 > (uint64_t) knock->noise_floor * knock->threshold_q4) {
+    // Knock! Back off quickly. Don't let the knock drag the noise floor up.
+    *retard = MIN(*retard + KNOCK_RETARD_STEP, KNOCK_RETARD_MAX);
+  } else {
+    // Clean cycle, creep back towards the map
+    *retard = MAX(*retard - KNOCK_RECOVER_STEP, 0);
+    knock->noise_floor += ((int64_t) energy - knock->noise_floor) >> KNOCK_FLOOR_SHIFT;
+  }
+}
+
+/**
+ * Open the window again at the next TDC that fires. On one cylinder that's the next compression
+ * TDC, so with the cam synced the exhaust TDC's valve noise never gets a window. With more, every
+ * TDC is some cylinder's.
+ */
+static inline void knock_reopen(Knock_t knock, event_t* event) {
+  event->mode = knock->cylinders == 1 ? NEXT_PHASE : NEXT_CYCLE;
+  event->what = knock_window_event_callback;
+  event->when.degrees = -knock->window_start_degrees;
+  event->when.us = 0;
+}
+
+static void knock_window_close_callback(event_t* event) {
+  Knock_t knock = event->param;
+  knock->window_count = knock_end_sampling(knock);
+  knock->window_pending = true;
+  knock_reopen(knock, event);
+}
+
+void knock_window_event_callback(event_t* event) {
+  Knock_t knock = event->param;
+  State_t state = state_get();
+
+  // Skip this window if the main loop hasn't got round to filtering the last one yet, it's
+  // still reading the samples
+  if (state.running && !knock->window_pending) {
+    knock->window_cylinder = knock_cylinder(knock, &state);
+    knock_begin_sampling(knock);
+
+    // Close the window later in this engine cycle
+    event->mode = SAME_CYCLE;
+    event->what = knock_window_close_callback;
+    event->when.degrees = -knock->window_end_degrees;
+    event->when.us = 0;
+
+  } else {
+    knock_reopen(knock, event);
+  }
+}
+
+void knock_poll(Knock_t knock) {
+  if (!knock->window_pending) return;
+
+  uint32_t energy = knock_goertzel(knock->samples, knock->window_count, knock->coeff_q12);
+  knock_update_retard(knock, knock->window_cylinder, energy);
+  knock->window_pending = false;
+}
+
+float knock_get_retard(Knock_t knock, const State_t* state) {
+  return knock->retard[knock_cylinder(knock, state)];
+}
+
+bool knock_sampling(Knock_t knock) {
+  return knock->sampling;
+}
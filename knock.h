@@ -0,0 +1,78 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef KNOCK_H
+#define KNOCK_H
+
+#include <pico/stdlib.h>
+#include "state.h"
+#include "scheduler.h"
+
+#define KNOCK_MAX_CYLINDERS 4
+#define KNOCK_MAX_SAMPLES 512
+#define KNOCK_SAMPLE_RATE_HZ 100000
+
+#define KNOCK_RETARD_STEP 2.0f
+#define KNOCK_RETARD_MAX 10.0f
+#define KNOCK_RECOVER_STEP 0.1f
+
+typedef struct knock* Knock_t;
+
+/**
+ * Construct a new knock detector.
+ *
+ * Once per cycle a sampling window is opened `window_start_degrees` after TDC and closed
+ * `window_end_degrees` after TDC. In between, the ADC free-runs on the knock sensor channel
+ * and DMA dumps the samples into a buffer. After the window closes, `knock_poll` computes the
+ * energy at `knock_frequency_hz` with a fixed-point Goertzel filter and compares it against
+ * a running noise floor. `threshold_q4` is the knock/floor ratio in 1/16ths. There's one
+ * sample buffer, in main SRAM, so there can only be one knock detector.
+ */
+Knock_t knock_init(
+  uint8_t pin,
+  uint8_t cylinders,
+  uint16_t knock_frequency_hz,
+  float window_start_degrees,
+  float window_end_degrees,
+  uint16_t threshold_q4
+);
+
+/**
+ * Scheduler event to (re)start the knock window. Schedule in degree mode at
+ * `-window_start_degrees`: NEXT_PHASE for one cylinder, NEXT_CYCLE for more.
+ */
+void knock_window_event_callback(event_t* event);
+
+/**
+ * Filter the last closed window, if there is one, and adjust its cylinder's retard. Call from
+ * core0's main loop: a full window is too much work for the alarm IRQ the trigger shares.
+ * The next window is skipped until this has run.
+ */
+void knock_poll(Knock_t knock);
+
+/**
+ * Timing retard currently requested for the cylinder firing at `state`'s next TDC
+ */
+float knock_get_retard(Knock_t knock, const State_t* state);
+
+/**
+ * True while the ADC is owned by the knock window. Don't touch the ADC if so.
+ */
+bool knock_sampling(Knock_t knock);
+
+/**
+ * Band energy at the knock frequency for `count` 12-bit samples. Exposed for testing.
+ * `coeff_q12` is 2cos(2πf/fs) in Q12.
+ */
+uint32_t knock_goertzel(const uint16_t* samples, uint16_t count, int32_t coeff_q12);
+
+/**
+ * Compare a window's band energy against the noise floor and adjust the retard of `cylinder`,
+ * the one the window belonged to. Exposed for testing.
+ */
+void knock_update_retard(Knock_t knock, uint8_t cylinder, uint32_t energy);
+
+#endif
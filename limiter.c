@@ -0,0 +1,109 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <pico/stdlib.h>
+#include "limiter.h"
+#include "arena.h"
+#include "state.h"
+
+/** Period thresholds for one limit. Shorter period means higher RPM */
+typedef struct limiter_threshold {
+  uint32_t engage_period;
+  uint32_t release_period;
+} limiter_threshold_t;
+
+struct limiter {
+  limiter_mode_t mode;
+  limiter_threshold_t normal;
+  limiter_threshold_t launch;
+  volatile bool launch_active;
+  bool limiting;
+  uint8_t retard_degrees;
+  uint8_t pattern_skip;
+  uint8_t pattern_of;
+  uint8_t pattern_index;
+};
+
+static limiter_threshold_t limiter_threshold_init(uint16_t rpm_limit, uint16_t rpm_hysteresis) {
+  limiter_threshold_t threshold;
+  uint16_t release_rpm = rpm_hysteresis < rpm_limit ? rpm_limit - rpm_hysteresis : 1;
+  threshold.engage_period = PERIOD(rpm_limit);
+  threshold.release_period = PERIOD(release_rpm);
+  return threshold;
+}
+
+Limiter_t limiter_init(
+  limiter_mode_t mode,
+  uint16_t rpm_limit,
+  uint16_t launch_rpm_limit,
+  uint16_t rpm_hysteresis
+) {
+  Limiter_t lim = arena_alloc(sizeof(struct limiter));
+  lim->mode = mode;
+  lim->normal = limiter_threshold_init(rpm_limit, rpm_hysteresis);
+  lim->launch = limiter_threshold_init(launch_rpm_limit, rpm_hysteresis);
+  lim->launch_active = false;
+  lim->limiting = false;
+  lim->retard_degrees = 0;
+  lim->pattern_skip = 1;
+  lim->pattern_of = 2;
+  lim->pattern_index = 0;
+
+  return lim;
+}
+
+void limiter_set_retard(Limiter_t lim, uint8_t retard_degrees) {
+  lim->retard_degrees = retard_degrees;
+}
+
+void limiter_set_pattern(Limiter_t lim, uint8_t skip, uint8_t of) {
+  lim->pattern_skip = MIN(skip, of);
+  lim->pattern_of = MAX(of, 1);
+  lim->pattern_index = 0;
+}
+
+void limiter_set_launch(Limiter_t lim, bool launch) {
+  lim->launch_active = launch;
+}
+
+limiter_action_t limiter_evaluate(Limiter_t lim, State_t* state) {
+  limiter_action_t action = { .cut = false, .retard_degrees = 0 };
+  limiter_threshold_t* threshold = lim->launch_active ? &lim->launch : &lim->normal;
+
+  // No period measured yet
+  if (state->physical_period == 0) {
+    return action;
+  }
+
+  // Hysteresis: engage at the limit, hold until we've dropped below the release speed
+  if (lim->limiting) {
+    lim->limiting = state->physical_period < threshold->release_period;
+  } else {
+    lim->limiting = state->physical_period <= threshold->engage_period;
+  }
+
+  if (!lim->limiting) {
+    lim->pattern_index = 0;
+    return action;
+  }
+
+  switch (lim->mode) {
+    case LIMITER_SOFT:
+      action.retard_degrees = lim->retard_degrees;
+      break;
+    case LIMITER_HARD:
+      action.cut = true;
+      break;
+    case LIMITER_PATTERN:
+      action.cut = lim->pattern_index < lim->pattern_skip;
+      if (++lim->pattern_index >= lim->pattern_of) {
+        lim->pattern_index = 0;
+      }
+      break;
+  }
+
+  return action;
+}
@@ -0,0 +1,69 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef LIMITER_H
+#define LIMITER_H
+
+#include <pico/stdlib.h>
+#include "state.h"
+
+/** Use to get Period from RPMs. Not for the hot path (division) */
+#define PERIOD(rpm) (60000000u / (rpm))
+
+typedef struct limiter* Limiter_t;
+typedef struct limiter_action limiter_action_t;
+typedef enum limiter_mode limiter_mode_t;
+
+/**
+ * SOFT retards timing, HARD cuts every spark, PATTERN cuts `skip` out of every `of` sparks
+ */
+enum limiter_mode {LIMITER_SOFT, LIMITER_HARD, LIMITER_PATTERN};
+
+/**
+ * What the ignition should do with the upcoming spark
+ */
+struct limiter_action {
+  /** Skip this spark entirely */
+  bool cut;
+
+  /** Degrees to subtract from the requested timing */
+  uint8_t retard_degrees;
+};
+
+/**
+ * Construct a new rev limiter.
+ * RPM limits are converted to period thresholds up front so `limiter_evaluate` is a
+ * handful of integer compares. The limiter engages at `rpm_limit` and releases once the
+ * engine falls below `rpm_limit - rpm_hysteresis`.
+ */
+Limiter_t limiter_init(
+  limiter_mode_t mode,
+  uint16_t rpm_limit,
+  uint16_t launch_rpm_limit,
+  uint16_t rpm_hysteresis
+);
+
+/**
+ * Degrees of retard applied in LIMITER_SOFT mode
+ */
+void limiter_set_retard(Limiter_t lim, uint8_t retard_degrees);
+
+/**
+ * Cut `skip` out of every `of` sparks in LIMITER_PATTERN mode
+ */
+void limiter_set_pattern(Limiter_t lim, uint8_t skip, uint8_t of);
+
+/**
+ * Switch between the normal and the launch control limit. Feel free to call in flight.
+ */
+void limiter_set_launch(Limiter_t lim, bool launch);
+
+/**
+ * Decide what to do with the next spark. O(1), integer only, safe to call from the spark callback.
+ */
+limiter_action_t limiter_evaluate(Limiter_t lim, State_t* state);
+
+#endif
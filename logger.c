@@ -0,0 +1,220 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/multicore.h>
+#include <pico/sync.h>
+#include <hardware/flash.h>
+#include "logger.h"
+#include "state.h"
+#include "ignition.h"
+
+#if !DEJA_RAM_HOT_PATH
+#error "The flash logger programs flash while the engine runs, build with DEJA_RAM_HOT_PATH"
+#endif
+
+typedef struct logger_block {
+  uint16_t magic;
+  uint8_t count;
+  uint8_t length;
+  uint32_t sequence;
+  uint8_t data[LOGGER_BLOCK_SIZE - 8];
+} logger_block_t;
+
+static_assert(sizeof(logger_block_t) == LOGGER_BLOCK_SIZE, "Log blocks must be one flash page");
+static_assert(LOGGER_FLASH_OFFSET % FLASH_SECTOR_SIZE == 0, "Log region must be sector aligned");
+
+/** Mask varint plus a 5 byte varint per field */
+#define LOGGER_MAX_RECORD ((LOGGER_FIELDS + 6) / 7 + LOGGER_FIELDS * 5)
+
+static struct {
+  // Filled by the listener (trigger IRQ), drained by `logger_poll()` (main loop). Same core.
+  logger_block_t blocks[LOGGER_BUFFERED_BLOCKS];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  bool open;
+  int32_t previous[LOGGER_FIELDS];
+  uint32_t sequence;
+  uint32_t dropped;
+
+  // Flash ring, offsets from LOGGER_FLASH_OFFSET
+  uint32_t write_offset;
+  uint32_t erased;
+} logger;
+
+void logger_init() {
+  const logger_block_t* flash = (const logger_block_t*) (XIP_BASE + LOGGER_FLASH_OFFSET);
+  bool found = false;
+  uint32_t last = 0;
+
+  // Newest block is the one with the highest sequence. Wrap safe, like the tick.
+  for (uint32_t i = 0; i < LOGGER_FLASH_SIZE / LOGGER_BLOCK_SIZE; ++i) {
+    if (flash[i].magic != LOGGER_MAGIC) continue;
+    if (!found || (int32_t) (flash[i].sequence - flash[last].sequence) > 0) {
+      last = i;
+      found = true;
+    }
+  }
+
+  logger.head = 0;
+  logger.tail = 0;
+  logger.open = false;
+  logger.dropped = 0;
+  logger.sequence = found ? flash[last].sequence + 1 : 0;
+  // Don't trust the rest of a sector we can't prove is erased. Start on the next one.
+  uint32_t end = found ? (last + 1) * LOGGER_BLOCK_SIZE : 0;
+  logger.write_offset = ((end + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE) % LOGGER_FLASH_SIZE;
+  logger.erased = 0;
+}
+
+static inline uint8_t logger_uvarint(uint8_t* out, uint32_t value) {
+  uint8_t length = 0;
+  while (value >= 0x80) {
+    out[length++] = value | 0x80;
+    value >>= 7;
+  }
+  out[length++] = value;
+  return length;
+}
+
+static inline uint8_t logger_varint(uint8_t* out, int32_t value) {
+  return logger_uvarint(out, ((uint32_t) value << 1) ^ (uint32_t) (value >> 31));
+}
+
+static uint8_t logger_encode(uint8_t* out, const int32_t* fields, const int32_t* previous) {
+  uint8_t deltas[LOGGER_FIELDS * 5];
+  uint32_t mask = 0;
+  uint8_t length = 0;
+  for (uint8_t i = 0; i < LOGGER_FIELDS; ++i) {
+    int32_t delta = fields[i] - previous[i] - (i == LOGGER_CLOCK);
+    if (delta == 0) continue;
+    mask |= 1u << i;
+    length += logger_varint(&deltas[length], delta);
+  }
+
+  // The mask's length depends on which fields changed, so it goes in front once it's known
+  uint8_t mask_length = logger_uvarint(out, mask);
+  memcpy(&out[mask_length], deltas, length);
+  return mask_length + length;
+}
+
+static void logger_close() {
+  logger.open = false;
+  ++logger.head;
+}
+
+static void logger_append(const int32_t* fields) {
+  uint8_t record[LOGGER_MAX_RECORD];
+  uint8_t length = 0;
+  logger_block_t* block = &logger.blocks[logger.head % LOGGER_BUFFERED_BLOCKS];
+
+  if (logger.open) {
+    length = logger_encode(record, fields, logger.previous);
+    if (block->length + length > sizeof(block->data)) {
+      logger_close();
+    }
+  }
+
+  if (!logger.open) {
+    if (logger.head - logger.tail >= LOGGER_BUFFERED_BLOCKS) {
+      ++logger.dropped;
+      return;
+    }
+    block = &logger.blocks[logger.head % LOGGER_BUFFERED_BLOCKS];
+    block->magic = LOGGER_MAGIC;
+    block->count = 0;
+    block->length = 0;
+    block->sequence = logger.sequence++;
+    memset(logger.previous, 0, sizeof(logger.previous));
+    logger.open = true;
+    length = logger_encode(record, fields, logger.previous);
+  }
+
+  memcpy(&block->data[block->length], record, length);
+  block->length += length;
+  memcpy(logger.previous, fields, sizeof(logger.previous));
+
+  if (++block->count == UINT8_MAX) {
+    logger_close();
+  }
+}
+
+void logger_listener(State_t* state, void* param) {
+  const ignition_plan_t* plan = ignition_get_plan(param);
+  int32_t fields[LOGGER_FIELDS];
+
+  fields[LOGGER_CLOCK] = state->clock;
+  fields[LOGGER_PERIOD] = state->physical_period;
+  fields[LOGGER_ADVANCE] = plan->advance * 10;
+  fields[LOGGER_DWELL] = plan->dwell_us;
+  fields[LOGGER_AIRFLOW] = state->airflow;
+  fields[LOGGER_HEAD_TEMP] = state->head_temp;
+  fields[LOGGER_BATTERY] = state->battery_voltage;
+  fields[LOGGER_FLAGS] = (state->running ? LOGGER_FLAG_RUNNING : 0)
+    | (state->cranking ? LOGGER_FLAG_CRANKING : 0)
+    | (plan->cut ? LOGGER_FLAG_CUT : 0)
+    | (state->cam_synced ? LOGGER_FLAG_CAM_SYNCED : 0)
+    | (plan->degraded ? LOGGER_FLAG_DEGRADED : 0);
+  fields[LOGGER_START_CYCLES] = state->start_cycles;
+
+  logger_append(fields);
+
+  // That's the end of the run, get it to flash while we're stopped
+  if (!state->running && logger.open) {
+    logger_close();
+  }
+}
+
+/**
+ * With the engine stopped, park core1 and keep core0's handlers out like `calibration_poll` does.
+ * While it runs that would hold off sparks and drop trigger edges for a whole sector erase, so
+ * there it's left to the RAM build: nothing on either core executes from or reads flash.
+ */
+static inline uint32_t logger_flash_begin(bool lockout) {
+  if (!lockout) return 0;
+  multicore_lockout_start_blocking();
+  return save_and_disable_interrupts();
+}
+
+static inline void logger_flash_end(bool lockout, uint32_t interrupts) {
+  if (!lockout) return;
+  restore_interrupts(interrupts);
+  multicore_lockout_end_blocking();
+}
+
+void logger_poll() {
+  bool waiting = logger.tail != logger.head;
+  bool program = waiting && logger.erased >= LOGGER_BLOCK_SIZE;
+  // Erase lazily: only while there's a log to write, and no further than a sector ahead of the
+  // writer. A board that's powered up but never runs doesn't wear the flash.
+  bool erase = !program && (waiting || logger.open) && logger.erased < LOGGER_ERASE_AHEAD;
+  if (!program && !erase) return;
+
+  bool lockout = !state_get().running;
+  uint32_t interrupts = logger_flash_begin(lockout);
+
+  if (program) {
+    // A page program takes well under a millisecond
+    logger_block_t* block = &logger.blocks[logger.tail % LOGGER_BUFFERED_BLOCKS];
+    flash_range_program(LOGGER_FLASH_OFFSET + logger.write_offset, (const uint8_t*) block, LOGGER_BLOCK_SIZE);
+    logger.write_offset = (logger.write_offset + LOGGER_BLOCK_SIZE) % LOGGER_FLASH_SIZE;
+    logger.erased -= LOGGER_BLOCK_SIZE;
+    ++logger.tail;
+  } else {
+    // Tens of milliseconds, so one per poll. The RAM blocks hold far more than that many cycles.
+    // This eats the oldest data in the ring.
+    uint32_t offset = (logger.write_offset + logger.erased) % LOGGER_FLASH_SIZE;
+    flash_range_erase(LOGGER_FLASH_OFFSET + offset, FLASH_SECTOR_SIZE);
+    logger.erased += FLASH_SECTOR_SIZE;
+  }
+
+  logger_flash_end(lockout, interrupts);
+}
+
+uint32_t logger_dropped() {
+  return logger.dropped;
+}
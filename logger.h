@@ -0,0 +1,94 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <pico/stdlib.h>
+#include <hardware/flash.h>
+#include "state.h"
+
+/**
+ * On-board per-cycle data logger, written to a ring in the upper part of flash.
+ *
+ * Every engine cycle appends one record to a page sized block in RAM. Blocks are written to
+ * flash from the main loop by `logger_poll()`, which erases sectors as the writer needs them,
+ * one ahead, so a run can log for as long as the ring lasts. With the engine stopped, writes
+ * take the same multicore lockout as calibration. While it runs they can't, so they rely on
+ * nothing executing from flash: the logger needs the DEJA_RAM_HOT_PATH build.
+ *
+ * Records are a few bytes, so at redline a single cylinder fills about a sector every few
+ * seconds, and one sector erase every few seconds is all the running engine costs the main loop.
+ *
+ * Block layout, all little endian:
+ *   uint16 magic, uint8 record count, uint8 data length, uint32 sequence, data[248]
+ * Each record is a presence mask with one bit per field (`logger_field`), as an unsigned varint,
+ * followed by a zigzag varint of the delta from the previous record for every bit that is set. The first
+ * record of a block is a delta from zero so every block decodes on its own. The clock is
+ * predicted to advance by one per record.
+ *
+ * Dump the region with picotool and decode it with logger_decode.py.
+ */
+#ifndef LOGGER_FLASH_OFFSET
+#define LOGGER_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES / 2)
+#endif
+
+#define LOGGER_FLASH_SIZE (PICO_FLASH_SIZE_BYTES - LOGGER_FLASH_OFFSET)
+#define LOGGER_BLOCK_SIZE FLASH_PAGE_SIZE
+/** Changes whenever the record format does, so old blocks are never misread */
+#define LOGGER_MAGIC 0x4A45
+
+/** RAM blocks waiting for flash. About a second of running at redline */
+#define LOGGER_BUFFERED_BLOCKS 8
+
+/** Erased space to keep ahead of the writer while logging */
+#define LOGGER_ERASE_AHEAD FLASH_SECTOR_SIZE
+
+enum logger_field {
+  LOGGER_CLOCK,
+  LOGGER_PERIOD,
+  /** Tenths of a degree */
+  LOGGER_ADVANCE,
+  LOGGER_DWELL,
+  LOGGER_AIRFLOW,
+  LOGGER_HEAD_TEMP,
+  LOGGER_BATTERY,
+  /** LOGGER_FLAG_* */
+  LOGGER_FLAGS,
+  /** `state.start_cycles`, so it only shows up in the record after a start */
+  LOGGER_START_CYCLES,
+  LOGGER_FIELDS
+};
+
+#define LOGGER_FLAG_RUNNING 1
+#define LOGGER_FLAG_CRANKING 2
+#define LOGGER_FLAG_CUT 4
+#define LOGGER_FLAG_CAM_SYNCED 8
+#define LOGGER_FLAG_DEGRADED 16
+
+/**
+ * Find the end of the existing log in flash and start appending after it
+ */
+void logger_init();
+
+/**
+ * State listener that logs the cycle. `param` is the ignition instance whose plan gets logged,
+ * so register it after `ignition_plan_listener`.
+ */
+void logger_listener(State_t* state, void* param);
+
+/**
+ * Write a waiting block to flash, or else erase the next sector if the log needs it. Call from
+ * core0's main loop, never from an IRQ.
+ */
+void logger_poll();
+
+/**
+ * Records thrown away because flash couldn't keep up
+ */
+uint32_t logger_dropped();
+
+#endif
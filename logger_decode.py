@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+"""
+Flash log decoder.
+
+Decodes a dump of the logger's flash region (see logger.h) into CSV, oldest record first.
+Every start's cycles to the first predictive spark are also printed to stderr.
+On a 2MB board the region is the upper megabyte:
+
+  picotool save -r 0x10100000 0x10200000 log.bin
+
+usage: logger_decode.py log.bin [out.csv]
+"""
+
+import struct
+import sys
+
+BLOCK_SIZE = 256
+HEADER = struct.Struct("<HBBI")
+MAGIC = 0x4A45
+
+# Same order as enum logger_field
+FIELDS = ["clock", "period", "advance", "dwell", "airflow", "head_temp", "battery", "flags",
+          "start_cycles"]
+CLOCK = 0
+ADVANCE = 2
+FLAGS = 7
+START_CYCLES = 8
+FLAG_CRANKING = 2
+
+
+def uvarint(data, position):
+  value = 0
+  shift = 0
+  while True:
+    byte = data[position]
+    position += 1
+    value |= (byte & 0x7F) << shift
+    shift += 7
+    if byte < 0x80:
+      break
+  return value, position
+
+
+def varint(data, position):
+  value, position = uvarint(data, position)
+  # Un-zigzag
+  return (value >> 1) ^ -(value & 1), position
+
+
+def blocks(dump):
+  found = []
+  for offset in range(0, len(dump) - BLOCK_SIZE + 1, BLOCK_SIZE):
+    magic, count, length, sequence = HEADER.unpack_from(dump, offset)
+    if magic != MAGIC:
+      continue
+    data = dump[offset + HEADER.size:offset + HEADER.size + length]
+    found.append((sequence, count, data))
+  if not found:
+    return []
+
+  # The ring starts right after the biggest jump backwards in sequence
+  found.sort()
+  gaps = [(found[i][0] - found[i - 1][0], i) for i in range(1, len(found))]
+  start = max(gaps)[1] if gaps and max(gaps)[0] > len(found) else 0
+  return found[start:] + found[:start]
+
+
+def records(block):
+  sequence, count, data = block
+  previous = [0] * len(FIELDS)
+  position = 0
+  for _ in range(count):
+    mask, position = uvarint(data, position)
+    record = list(previous)
+    record[CLOCK] += 1
+    for i in range(len(FIELDS)):
+      if mask & (1 << i):
+        delta, position = varint(data, position)
+        record[i] += delta
+    previous = record
+    yield sequence, record
+
+
+def main():
+  if len(sys.argv) < 2:
+    print(__doc__.strip())
+    sys.exit(2)
+
+  with open(sys.argv[1], "rb") as f:
+    dump = f.read()
+  out = open(sys.argv[2], "w") if len(sys.argv) > 2 else sys.stdout
+
+  out.write(",".join(["block"] + FIELDS) + "\n")
+  total = 0
+  cranking = False
+  for block in blocks(dump):
+    for sequence, record in records(block):
+      row = [sequence] + record
+      row[ADVANCE + 1] = record[ADVANCE] / 10
+      out.write(",".join(str(v) for v in row) + "\n")
+      total += 1
+
+      # The trigger sets start_cycles on the record cranking ends on
+      if cranking and not record[FLAGS] & FLAG_CRANKING:
+        print("start in %d cycles (block %d, clock %d)"
+              % (record[START_CYCLES], sequence, record[CLOCK]), file=sys.stderr)
+      cranking = bool(record[FLAGS] & FLAG_CRANKING)
+
+  print("%d records" % total, file=sys.stderr)
+
+
+if __name__ == "__main__":
+  main()
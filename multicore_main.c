@@ -6,66 +6,221 @@
 
 #include <pico/stdlib.h>
 #include <pico/multicore.h>
+#include <hardware/irq.h>
+#include <hardware/structs/sio.h>
+#include <pico/sync.h>
+#include "config.h"
 #include "scheduler.h"
 #include "timing.h"
 #include "ignition.h"
 #include "trigger.h"
 #include "state.h"
+#include "limiter.h"
+#include "knock.h"
+#include "calibration.h"
+#include "injection.h"
+#include "tune.h"
+#include "idle.h"
+#include "capture.h"
+#include "traction.h"
+#include "strobe.h"
+#include "arena.h"
+#include "cycles.h"
+#if DEJA_LOGGER
+#include "logger.h"
+#endif
 #include "helpers.h"
 
-#define IGN_MANUAL_TRIGGER_PIN 16
-#define TRIGGER_PIN 26
-#define IGN_COIL_PIN 22
-#define IGN_TIMING_LIGHT_PIN 15
-#define TIMING_COURSE_ADJUST_PIN = 28
-#define TIMING_ADC_CHANNEL 2
-
-#define TRIGGERS_PER_REVOLUTION 1
-#define IGN_TIMING_LIGHT_PULSE_US 0 // 100 to enable
-#define IGN_DWELL_US 1500
+static void manual_trigger_adjust_callback(event_t* event);
+static void sensor_poll_callback(event_t* event);
+static void core1_doorbell_listener(State_t* state, void* param);
+static void core0_refresh_listener(State_t* state, void* param);
+static void core1_doorbell_irq();
+static void core1_main();
 
-#define SCHEDULER_0_ALARM 1
-#define SCHEDULER_1_ALARM 2
+/** Doorbell word. Anything but the lockout handshake words will do */
+#define CORE1_DOORBELL 0
+/** `multicore_lockout` handshake words, as used by the SDK */
+#define CORE1_LOCKOUT_MAGIC_START 0x73a8831eu
+#define CORE1_LOCKOUT_MAGIC_END (~CORE1_LOCKOUT_MAGIC_START)
 
-static void manual_trigger_adjust_callback(event_t* event);
+// Built on core0 and only ever touched there: by the plan listener, and the limiter by the launch
+// input poll too. Core1's spark path only sees what the listener publishes in the plan.
+static Knock_t knock;
+static Limiter_t limiter;
+static Traction_t traction;
+static Calibration_t calibration;
+static Scheduler_t core0_scheduler;
+static Scheduler_t core1_scheduler;
 
 static void core0_main() {
   Scheduler_t scheduler = scheduler_init(SCHEDULER_0_ALARM);
+  core0_scheduler = scheduler;
 
-  Trigger_t trigger = trigger_init(
-    TRIGGER_COIL_DIGITAL,
-    TRIGGER_PIN,
-    TRIGGERS_PER_REVOLUTION,
-    0
-  );
+  // Live tuning. Publish committed maps before anything reads them at the cycle boundary
+  tune_init(TIMING_STATIC_VALUE, IGN_DWELL_US, TUNE_RPM_MAX);
+  state_add_listener(tune_listener, NULL);
+
+#if DEJA_LOGGER
+  logger_init();
+#endif
+
+  Trigger_t trigger = trigger_init(0);
+
+  calibration = calibration_init(CALIBRATION_RPM_MIN, CALIBRATION_RPM_MAX);
+  calibration_load(calibration);
+#ifdef CALIBRATION_SENSE_PIN
+  calibration_sense_init(calibration, CALIBRATION_SENSE_PIN);
+#endif
+  trigger_set_calibration(trigger, calibration);
+  gpio_init(CALIBRATION_BUTTON_PIN);
+  gpio_set_dir(CALIBRATION_BUTTON_PIN, GPIO_IN);
+  gpio_pull_down(CALIBRATION_BUTTON_PIN);
 
-  event_t trigger_event = scheduler_event_init(trigger_event_callback, RELATIVE_US, -1, TRIGGER_POLL_PERIOD, trigger);
+  event_t trigger_event = scheduler_event_init(trigger_event_callback, RELATIVE_US, -1, TRIGGER_EVENT_PERIOD, trigger);
   scheduler_add_event(scheduler, trigger_event);
 
-  event_t adjust_event = scheduler_event_init(manual_trigger_adjust_callback, RELATIVE_US, -1, 100000, NULL);
+#ifdef KNOCK_PIN
+  knock = knock_init(
+    KNOCK_PIN,
+    KNOCK_CYLINDERS,
+    KNOCK_FREQUENCY_HZ,
+    KNOCK_WINDOW_START_DEGREES,
+    KNOCK_WINDOW_END_DEGREES,
+    KNOCK_THRESHOLD_Q4
+  );
+
+  event_t knock_event = scheduler_event_init(knock_window_event_callback, KNOCK_CYLINDERS == 1 ? NEXT_PHASE : NEXT_CYCLE, -KNOCK_WINDOW_START_DEGREES, 0, knock);
+  scheduler_add_event(scheduler, knock_event);
+#else
+  knock = NULL;
+#endif
+
+  event_t adjust_event = scheduler_event_init(manual_trigger_adjust_callback, RELATIVE_US, -1, 100000, knock);
   scheduler_add_event(scheduler, adjust_event);
 
-  tight_loop_contents();
+  limiter = limiter_init(REV_LIMIT_MODE, REV_LIMIT_RPM, REV_LIMIT_LAUNCH_RPM, REV_LIMIT_HYSTERESIS_RPM);
+  limiter_set_retard(limiter, REV_LIMIT_RETARD_DEGREES);
+  limiter_set_pattern(limiter, REV_LIMIT_PATTERN_SKIP, REV_LIMIT_PATTERN_OF);
+
+#ifdef BATTERY_PIN
+  adc_gpio_init(BATTERY_PIN);
+#endif
+#ifdef LAUNCH_PIN
+  gpio_init(LAUNCH_PIN);
+  gpio_set_dir(LAUNCH_PIN, GPIO_IN);
+  if (LAUNCH_ACTIVE_LEVEL) {
+    gpio_pull_down(LAUNCH_PIN);
+  } else {
+    gpio_pull_up(LAUNCH_PIN);
+  }
+#endif
+  event_t sensor_event = scheduler_event_init(sensor_poll_callback, RELATIVE_US, -1, SENSOR_POLL_PERIOD, knock);
+  scheduler_add_event(scheduler, sensor_event);
+
+  // Wheel speeds are captured by PIO and DMA, and only looked at from the plan listener
+  traction = traction_init(
+    capture_init(REAR_WHEEL_PIN),
+    capture_init(FRONT_WHEEL_PIN),
+    TC_DRIVEN_SCALE,
+    TC_SLIP_TARGET,
+    TC_SLIP_CUT,
+    TC_MAX_RETARD_DEGREES,
+    TC_MIN_SPEED_HZ
+  );
+
+  arena_check();
+  multicore_launch_core1(core1_main);
+
+  // Everything else happens in alarm callbacks. Sleep until one of them gives us work.
+#if CYCLE_COUNT
+  cycles_init();
+#endif
+  idle_init();
+  while (true) {
+    tune_poll();
+    calibration_poll(calibration);
+#ifdef KNOCK_PIN
+    knock_poll(knock);
+#endif
+#if DEJA_LOGGER
+    logger_poll();
+#endif
+    idle_wait();
+  }
 }
 
 static void core1_main() {
   Scheduler_t scheduler = scheduler_init(SCHEDULER_1_ALARM);
+  core1_scheduler = scheduler;
 
-  Ignition_t ignition = ignition_init(
-    IGN_COIL_PIN,
-    IGN_TIMING_LIGHT_PIN,
-    IGN_DWELL_US,
-    IGN_TIMING_LIGHT_PULSE_US,
-    timing_static
-  );
+  Ignition_t ignition = ignition_init(timing_mapped);
+  ignition_set_dwell_func(ignition, dwell_mapped);
+
+  ignition_set_limiter(ignition, limiter);
+  ignition_set_knock(ignition, knock);
+  ignition_set_traction(ignition, traction);
+
+  // Plan each spark as soon as the trigger measures the cycle, then wake core1 to arm it
+  state_add_listener(ignition_plan_listener, ignition);
+#if IGN_TIMING_LIGHT_PULSE_US
+  // Timed by PIO off of the coil pin. The listener only hands over the delay for the next spark
+  Strobe_t strobe = strobe_init(ignition);
+#ifdef IGN_TIMING_LIGHT_DEGREES
+  strobe_at_degrees(strobe, IGN_TIMING_LIGHT_DEGREES);
+#endif
+  state_add_listener(strobe_listener, strobe);
+#endif
+  state_add_listener(core1_doorbell_listener, NULL);
+#ifdef CALIBRATION_SENSE_PIN
+  // Only needs the plan once the spark has fired, so it can wait behind the doorbell
+  calibration_set_ignition(calibration, ignition);
+  state_add_listener(calibration_listener, calibration);
+#endif
+#if DEJA_LOGGER
+  // After the doorbell, so logging never delays it
+  state_add_listener(logger_listener, ignition);
+#endif
+  // Knock and injection wait on the cycle too, but nothing there is as urgent as the spark
+  Injection_t injection = injection_init(INJ_REQ_FUEL_US, INJ_SOI_DEGREES, INJ_RPM_MAX);
+  Injector_t injector = injection_add_injector(injection, INJECTOR_PIN, 0);
+  state_add_listener(injection_plan_listener, injection);
+  state_add_listener(core0_refresh_listener, core0_scheduler);
+  multicore_fifo_drain();
+  irq_set_exclusive_handler(SIO_IRQ_PROC1, core1_doorbell_irq);
+  irq_set_enabled(SIO_IRQ_PROC1, true);
 
-  event_t ignition_event = scheduler_event_init(ignition_event_callback, NEXT_CYCLE, TIMING_STATIC_VALUE, -IGN_DWELL_US, ignition);
+  event_t ignition_event = scheduler_event_init(ignition_event_callback, RELATIVE_US, -1, IGN_CRANK_POLL_US, ignition);
   scheduler_add_event(scheduler, ignition_event);
 
-  tight_loop_contents();
+  event_t injection_event = scheduler_event_init(injection_event_callback, NEXT_PHASE, INJ_SOI_DEGREES, 0, injector);
+  scheduler_add_event(scheduler, injection_event);
+
+  arena_check();
+#if CYCLE_COUNT
+  cycles_init();
+#endif
+  idle_init();
+  while (true) {
+    idle_wait();
+  }
 }
 
 static void manual_trigger_adjust_callback(event_t* event) {
+  // Calibrate the trigger offset for as long as the button is held
+  bool calibrating = gpio_get(CALIBRATION_BUTTON_PIN);
+  if (calibrating && !calibration_active(calibration)) {
+    calibration_begin(calibration);
+  } else if (!calibrating && calibration_active(calibration)) {
+    calibration_end(calibration);
+  }
+
+  // Once calibrated, the pot is only read while calibrating
+  if (calibration_valid(calibration) && !calibrating) return;
+
+  // The knock window owns the ADC while it's open
+  if (event->param && knock_sampling(event->param)) return;
+
   uint millivolts = read_adc_channel(TIMING_ADC_CHANNEL);
 
   int32_t degrees = (int) ((1650.0f - millivolts) * (12.0f / 3300.0f));
@@ -74,15 +229,96 @@ static void manual_trigger_adjust_callback(event_t* event) {
   state_commit_write(&state);
 }
 
+static void sensor_poll_callback(event_t* event) {
+#ifdef LAUNCH_PIN
+  // The limiter is only ever evaluated on this core, so switching it here can't race a spark plan
+  limiter_set_launch(limiter, gpio_get(LAUNCH_PIN) == LAUNCH_ACTIVE_LEVEL);
+#endif
+
+#ifdef BATTERY_PIN
+  // The knock window owns the ADC while it's open
+  if (event->param && knock_sampling(event->param)) return;
+
+  uint16_t battery_millivolts = read_adc_channel(BATTERY_PIN - ADC_CHANNEL_OFFSET) * BATTERY_DIVIDER;
+#else
+  uint16_t battery_millivolts = BATTERY_NOMINAL_MV;
+#endif
+  State_t state = state_begin_write();
+  state.battery_voltage = battery_millivolts;
+  state_commit_write(&state);
+}
+
+/**
+ * Runs on core0 when the engine clock advances. Its own degree mode events are parked until
+ * then, same as core1's.
+ */
+static void core0_refresh_listener(State_t* state, void* param) {
+  scheduler_refresh(param, state);
+}
+
+/**
+ * Runs on core0 when the engine clock advances. Pokes core1 so its parked events get scheduled.
+ */
+static void core1_doorbell_listener(State_t* state, void* param) {
+  if (multicore_fifo_wready()) {
+    multicore_fifo_push_blocking(CORE1_DOORBELL);
+  }
+}
+
+static inline void core1_fifo_push(uint32_t word) {
+  while (!multicore_fifo_wready()) {
+    tight_loop_contents();
+  }
+  sio_hw->fifo_wr = word;
+  __sev();
+}
+
+static inline uint32_t core1_fifo_pop() {
+  while (!multicore_fifo_rvalid()) {
+    __wfe();
+  }
+  return sio_hw->fifo_rd;
+}
+
+/**
+ * Park core1 for core0's `multicore_lockout_start_blocking`, so core0 can write flash. The SDK's
+ * own victim handler wants the FIFO IRQ to itself, which the doorbell needs, so the handshake is
+ * answered here instead. Spins from RAM with interrupts off until core0 lets go.
+ */
+static void __not_in_flash_func(core1_lockout)() {
+  uint32_t interrupts = save_and_disable_interrupts();
+  core1_fifo_push(CORE1_LOCKOUT_MAGIC_START);
+  while (core1_fifo_pop() != CORE1_LOCKOUT_MAGIC_END) {
+    tight_loop_contents();
+  }
+  core1_fifo_push(CORE1_LOCKOUT_MAGIC_END);
+  restore_interrupts(interrupts);
+}
+
+/**
+ * Same priority as the alarm IRQ, so this never preempts a scheduler callback
+ */
+static void core1_doorbell_irq() {
+  while (multicore_fifo_rvalid()) {
+    if (sio_hw->fifo_rd == CORE1_LOCKOUT_MAGIC_START) {
+      // Doorbells rung meanwhile were swallowed, so refresh below regardless
+      core1_lockout();
+    }
+  }
+  multicore_fifo_clear_irq();
+  State_t state = state_get();
+  scheduler_refresh(core1_scheduler, &state);
+}
+
 static void init() {
 
 }
 
 int main() {
+  stdio_init_all();
   state_init();
 
   core0_main();
-  multicore_launch_core1(core1_main);
 
   return 0;
 }
@@ -0,0 +1,36 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Bench rig: a signal generator into the analog coil input, and the timing light pulsing on
+ * every spark. Rev limit kept to what a bench coil is comfortable with. The `deja_bench` target.
+ * Everything not set here is the default in config.h.
+ *
+ * No knock sensor: the analog trigger reads the ADC on every poll, which would break into the
+ * knock window's free-running conversions. No battery measurement either, the bench supply is
+ * assumed to be at BATTERY_NOMINAL_MV.
+ */
+
+#ifndef PROFILE_BENCH_H
+#define PROFILE_BENCH_H
+
+/** Board */
+#define TRIGGER_PIN 26
+#define CALIBRATION_SENSE_PIN 14 // Coil-sense pickup for measured calibration. Undefine to calibrate by hand
+
+/** Trigger */
+#define TRIGGER_TYPE TRIGGER_COIL_ANALOG
+
+/** Ignition */
+#define IGN_TIMING_LIGHT_PULSE_US 100
+
+#define REV_LIMIT_RPM 6000
+#define REV_LIMIT_LAUNCH_RPM 4000
+
+/** Callback cycle counts over TUNE_CYCLES */
+#define CYCLE_COUNT 1
+
+#endif
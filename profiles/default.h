@@ -0,0 +1,29 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Single cylinder, one trigger per revolution, on a Pico. The `deja` target. Everything not set
+ * here is the default in config.h.
+ */
+
+#ifndef PROFILE_DEFAULT_H
+#define PROFILE_DEFAULT_H
+
+/** Board */
+#define KNOCK_PIN 27
+#define BATTERY_PIN 26
+#define BATTERY_DIVIDER 5.7f // Vehicle battery through 47k over 10k, 18.8V full scale
+#define CALIBRATION_SENSE_PIN 14 // Coil-sense pickup for measured calibration. Undefine to calibrate by hand
+#define LAUNCH_PIN 12 // Clutch switch to ground. Holds the launch rev limit while pulled in
+
+/** Cam sync. Leave CAM_PIN undefined to run wasted spark only */
+#define CAM_PIN 20
+
+/** Ignition */
+// #define IGN_TIMING_LIGHT_PULSE_US 100 // Enable the strobe
+// #define IGN_TIMING_LIGHT_DEGREES 0 // Flash at TDC instead of on the spark
+
+#endif
@@ -4,11 +4,15 @@
  * file, You can obtain one at http://mozilla.org/MPL/2.0/.
  */
 
+#include <math.h>
 #include <pico/stdlib.h>
 #include <pico/time.h>
+#include "config.h"
 #include "scheduler.h"
+#include "arena.h"
 #include "state.h"
-#include "helpers.h"
+#include "tick.h"
+#include "cycles.h"
 
 static bool scheduler_add_alarm(Scheduler_t sched, scheduled_event_t* item, State_t* state);
 static int64_t scheduler_alarm_callback(alarm_id_t id, void* data);
@@ -17,75 +21,124 @@ struct scheduler {
   scheduled_event_t items[SCHEDULER_MAX_ITEMS];
   uint8_t num_items;
   alarm_pool_t* alarm_pool;
+  StateStore_t store;
+  volatile uint32_t late;
+  volatile uint32_t overflows;
 };
 
 static inline bool needs_scheduling(scheduled_event_t* item) {
   return !(item->scheduled || item->event.mode == CANCEL);
 }
 
-static inline uint64_t event_to_us_since_boot(scheduled_event_t* item, State_t* state) {
-  uint64_t next_time;
-
-  // Cancel event
-  if (item->event.mode == CANCEL) {
-    // TODO: Remove the thing
-    next_time = 0;
-  }
-
-  // Relative time mode
-  if (item->event.mode == RELATIVE_US) {
-    next_time = time_us_64() + item->event.when.us;
-  }
-
-  // Absolute time mode
-  if (item->event.mode == ABSOLUTE_US) {
-    next_time = item->event.when.us;
-  }
-
-  // Degree mode - Schedule for current cycle (next tdc)
-  if (item->event.mode == SAME_CYCLE && item->clock == state->clock) {
-    next_time = state->next_tdc - item->event.when.degrees * state->physical_period / 360.f;
-  }
-
-  // Degree mode - Schedule for next cycle (next tdc)
-  if (item->event.mode == NEXT_CYCLE && item->clock == state->clock - 1) {
-    next_time = state->next_tdc - item->event.when.degrees * state->physical_period / 360.f;
-  }
-
-  // Degree mode - Schedule for current cycle (previous tdc)
-  if (item->event.mode == SAME_CYCLE && item->clock == state->clock - 1) {
-    next_time = state->next_tdc - state->ignition_period - item->event.when.degrees * state->physical_period / 360.f;
-  }
-
-  // Degree mode - Schedule for next cycle (previous tdc)
-  if (next_time == NEXT_CYCLE && item->clock == state->clock) {
-    next_time = 0;
-    // next_time = state->next_tdc + state->ignition_period - item->event.when.degrees * state->physical_period / 360.f;
+/**
+ * Resolves an event to the tick it should fire at, and the engine clock it's for. Returns false
+ * if it shouldn't be scheduled.
+ */
+static inline bool event_to_tick(scheduled_event_t* item, State_t* state, tick_t* next_time, engine_clock_t* clock) {
+  *clock = state->clock;
+  switch (item->event.mode) {
+    case CANCEL:
+      // TODO: Remove the thing
+      return false;
+
+    // Relative time mode
+    case RELATIVE_US:
+      *next_time = tick_now() + item->event.when.us;
+      return true;
+
+    // Absolute time mode
+    case ABSOLUTE_US:
+      *next_time = (tick_t) item->event.when.us;
+      return true;
+
+    case SAME_CYCLE:
+      // Stays with the cycle it was scheduled in
+      *clock = item->clock;
+      // Degree mode - Schedule for current cycle (next tdc)
+      if (item->clock == state->clock) {
+        *next_time = state->next_tdc - (tick_diff_t) (item->event.when.degrees * state->physical_period / 360.f);
+        return true;
+      }
+      // Degree mode - Schedule for current cycle (previous tdc)
+      if (item->clock == state->clock - 1) {
+        *next_time = state->next_tdc - state->ignition_period - (tick_diff_t) (item->event.when.degrees * state->physical_period / 360.f);
+        return true;
+      }
+      return false;
+
+    case NEXT_CYCLE:
+      // Degree mode - Schedule for next cycle (next tdc)
+      if (item->clock == state->clock - 1) {
+        *next_time = state->next_tdc - (tick_diff_t) (item->event.when.degrees * state->physical_period / 360.f);
+        return true;
+      }
+      // Degree mode - Schedule for next cycle (previous tdc)
+      // next_time = state->next_tdc + state->ignition_period - item->event.when.degrees * state->physical_period / 360.f;
+      return false;
+
+    // Parked until the next refresh
+    case WAIT_CYCLE:
+      return false;
+
+    case NEXT_PHASE: {
+      // Degrees from next_tdc on to the compression TDC, and its clock value. Every TDC counts
+      // as a compression TDC while the phase is unknown.
+      uint16_t ahead = state->cam_synced ? (720 - state->phase) % 720 : 0;
+      *clock = state->clock + ahead * TRIGGERS_PER_REVOLUTION / 360;
+      if (*clock == item->clock) {
+        // Already fired for this one
+        return false;
+      }
+      float degrees = fmodf(item->event.when.degrees, state->cam_synced ? 720.f : 360.f);
+      *next_time = state->next_tdc + (tick_diff_t) ((ahead - degrees) * state->physical_period / 360.f);
+      if (tick_diff(*next_time, tick_now()) < 0) {
+        // Too late for this cycle. A later refresh picks up the next compression TDC
+        return false;
+      }
+      return true;
+    }
   }
 
-  return next_time;
+  return false;
 }
 
 static bool scheduler_add_alarm(Scheduler_t sched, scheduled_event_t* item, State_t* state) {  
-  uint64_t time = event_to_us_since_boot(item, state);
-
-  if (item->event.mode == CANCEL || time == 0) {
+  tick_t time;
+  engine_clock_t clock;
+  if (!event_to_tick(item, state, &time, &clock)) {
     return false;
   }
 
-  if (item->event.mode != SAME_CYCLE) {
-    item->clock = state->clock;
-  }
+  // Relative times are never due before they were asked for. Zero means right away.
+  bool relative = item->event.mode == RELATIVE_US;
+
+  // Set before the add, since a callback that's already due runs inside it
+  engine_clock_t previous = item->clock;
+  item->clock = clock;
 
   alarm_id_t alarm_id = alarm_pool_add_alarm_at(
     sched->alarm_pool,
-    to_absolute_time_t(time),
+    tick_to_absolute_time(time),
     scheduler_alarm_callback,
     item,
     true
   );
 
-  assert(alarm_id >= 0);
+  if (alarm_id < 0) {
+    // No alarm to be had. Leave it for the next refresh rather than lose it, which needs the
+    // clock it had, or the cycle modes would take it as done for this cycle
+    item->clock = previous;
+    ++sched->overflows;
+    return false;
+  }
+  if (alarm_id == 0) {
+    // Already due, so the pool ran the callback right here, and that rescheduled the event.
+    // Whether it's still scheduled is up to that, not us.
+    if (!relative) {
+      ++sched->late;
+    }
+    return item->scheduled;
+  }
   item->alarm_id = alarm_id;
 
   return true;
@@ -93,20 +146,30 @@ static bool scheduler_add_alarm(Scheduler_t sched, scheduled_event_t* item, Stat
 
 static int64_t scheduler_alarm_callback(alarm_id_t id, void* data) {
   scheduled_event_t* item = data;
+#if CYCLE_COUNT
+  uint32_t cycles_start = cycles_now();
+  event_func_t what = item->event.what;
+#endif
   item->event.what(&(item->event));
 
   if (item->event.mode != CANCEL) {
-    State_t state = state_get();
+    State_t state = state_store_get(item->scheduler->store);
     item->scheduled = scheduler_add_alarm(item->scheduler, item, &state);
   }
 
+#if CYCLE_COUNT
+  cycles_record(what, cycles_start);
+#endif
   return 0;
 }
 
 Scheduler_t scheduler_init(uint8_t alarm_num) {
-  Scheduler_t sched = malloc(sizeof(struct scheduler));
+  Scheduler_t sched = arena_alloc(sizeof(struct scheduler));
   sched->alarm_pool = alarm_pool_create(alarm_num, SCHEDULER_MAX_ITEMS);
   sched->num_items = 0;
+  sched->store = state_default_store();
+  sched->late = 0;
+  sched->overflows = 0;
 
   return sched;
 }
@@ -115,7 +178,7 @@ event_t scheduler_event_init(
   event_func_t what,
   schedule_mode_t mode,
   float degrees,
-  int64_t us,
+  int32_t us,
   void* param
 ) {
   event_t item;
@@ -129,7 +192,7 @@ event_t scheduler_event_init(
 
 event_id_t scheduler_add_event(Scheduler_t sched, event_t event) {
   scheduled_event_t* sched_event = &(sched->items[sched->num_items]);
-  State_t state = state_get();
+  State_t state = state_store_get(sched->store);
 
   sched_event->event = event;
   sched_event->clock = state.clock;
@@ -137,7 +200,7 @@ event_id_t scheduler_add_event(Scheduler_t sched, event_t event) {
   sched_event->scheduled = false;
   sched_event->scheduler = sched;
 
-  scheduler_add_alarm(sched, sched_event, &state);
+  sched_event->scheduled = scheduler_add_alarm(sched, sched_event, &state);
 
   return sched->num_items++;
 }
@@ -145,12 +208,29 @@ event_id_t scheduler_add_event(Scheduler_t sched, event_t event) {
 void scheduler_refresh(Scheduler_t sched, State_t* state) {
   if (!state->running) return;
   for (uint8_t i = 0; i < sched->num_items; ++i) {
-    if (sched->items[i].scheduled) continue;
-    if (sched->items[i].clock > state->clock) continue;
-    scheduler_add_alarm(sched, sched->items + i, state);
+    scheduled_event_t* item = sched->items + i;
+    if (item->scheduled) continue;
+    if (item->event.mode == WAIT_CYCLE) {
+      // Wake parked events right away
+      item->event.mode = RELATIVE_US;
+      item->event.when.us = 0;
+    }
+    item->scheduled = scheduler_add_alarm(sched, item, state);
   }
 }
 
+uint32_t scheduler_late(Scheduler_t sched) {
+  return sched->late;
+}
+
+uint32_t scheduler_overflows(Scheduler_t sched) {
+  return sched->overflows;
+}
+
+void scheduler_set_state_store(Scheduler_t sched, StateStore_t store) {
+  sched->store = store;
+}
+
 
 
 
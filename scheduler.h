@@ -9,6 +9,7 @@
 
 #include <pico/stdlib.h>
 #include "state.h"
+#include "tick.h"
 
 #define SCHEDULER_MAX_ITEMS 4
 // #define EVENT_CANCEL 0
@@ -25,11 +26,20 @@ typedef void (*event_func_t)(event_t*);
 typedef uint8_t event_id_t;
 typedef enum schedule_mode schedule_mode_t;
 
-enum schedule_mode {CANCEL, RELATIVE_US, ABSOLUTE_US, SAME_CYCLE, NEXT_CYCLE};
+/**
+ * WAIT_CYCLE parks the event until the next `scheduler_refresh`, which fires it right away.
+ * NEXT_PHASE fires once per 720 degree engine cycle, `degrees` (-360 to 720, negative is after) before cylinder 1's
+ * compression TDC. Without cam sync it falls back to once per TDC, at `degrees` modulo 360.
+ */
+enum schedule_mode {CANCEL, RELATIVE_US, ABSOLUTE_US, SAME_CYCLE, NEXT_CYCLE, WAIT_CYCLE, NEXT_PHASE};
 
+/**
+ * Degrees before TDC for the cycle modes, or before compression TDC for NEXT_PHASE, otherwise µs.
+ * In ABSOLUTE_US mode `us` holds a tick_t.
+ */
 struct engine_time {
   float degrees;
-  int64_t us;
+  int32_t us;
 };
 
 struct event {
@@ -41,7 +51,7 @@ struct event {
 
 struct scheduled_event {
   event_id_t id;
-  uint64_t clock;
+  engine_clock_t clock;
   event_t event;
   bool scheduled;
   alarm_id_t alarm_id;
@@ -52,13 +62,34 @@ Scheduler_t scheduler_init(uint8_t alarm_num);
 
 event_id_t scheduler_add_event(Scheduler_t sched, event_t item);
 
+/**
+ * Try again to schedule events that couldn't be resolved to a time when they were last
+ * rescheduled. Call on the scheduler's own core whenever the engine clock advances.
+ */
 void scheduler_refresh(Scheduler_t sched, State_t* state);
 
+/**
+ * Events that were already due by the time they were scheduled, and so ran straight away.
+ * Whether that's acceptable is up to each callback, which can tell from its own deadline.
+ * Relative times aren't counted: zero asks for right away, which isn't late.
+ */
+uint32_t scheduler_late(Scheduler_t sched);
+
+/**
+ * Events the alarm pool had no room for. They're retried on the next refresh instead of lost.
+ */
+uint32_t scheduler_overflows(Scheduler_t sched);
+
+/**
+ * Resolve cycle events against `store` instead of the state singleton. Set before adding events.
+ */
+void scheduler_set_state_store(Scheduler_t sched, StateStore_t store);
+
 event_t scheduler_event_init(
   event_func_t what,
   schedule_mode_t mode,
   float degrees,
-  int64_t us,
+  int32_t us,
   void* param
 );
 
@@ -0,0 +1,187 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Per-callback cost of the hot path, on the host.
+ *
+ * Runs one simulated engine (see engine.h) at a steady speed and times every alarm callback,
+ * by what it did: a trigger stall check, a dwell start, a spark, or a spark path poll, and the
+ * trigger's edge IRQ with the state listeners behind it (plan and doorbell). Also times the tick
+ * to absolute time conversion every alarm goes through, against the 64-bit `time_us_64()` one it
+ * replaced.
+ *
+ * These are host nanoseconds. They're for comparing revisions of the same code: run it before
+ * and after a change. The M0+ has no 64-bit ALU, so 64-bit math that's a single instruction
+ * here is several there, and a 64-bit multiply or divide is a library call.
+ *
+ * usage: deja_bench [-r rpm] [-s seconds]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pico/stdlib.h>
+#include <pico/time.h>
+#include "config.h"
+#include "engine.h"
+#include "tune.h"
+#include "tick.h"
+
+#define BENCH_CONVERSIONS 10000000
+
+typedef enum bench_kind {
+  BENCH_TRIGGER_STALL_CHECK,
+  BENCH_TRIGGER_EDGE,
+  BENCH_DWELL_START,
+  BENCH_SPARK,
+  BENCH_SPARK_POLL,
+  BENCH_KINDS
+} bench_kind_t;
+
+static const char* BENCH_NAMES[BENCH_KINDS] = {
+  "trigger stall check",
+  "trigger edge IRQ + listeners",
+  "dwell start",
+  "spark",
+  "spark path poll"
+};
+
+typedef struct bench_stats {
+  uint64_t calls;
+  uint64_t total_ns;
+  uint64_t max_ns;
+} bench_stats_t;
+
+static inline uint64_t bench_now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+static bench_stats_t bench_stats[BENCH_KINDS];
+static uint64_t bench_overhead_ns;
+static void (*bench_trigger_irq_handler)();
+static StateStore_t bench_store;
+
+static void bench_record(bench_kind_t kind, uint64_t elapsed) {
+  elapsed = elapsed > bench_overhead_ns ? elapsed - bench_overhead_ns : 0;
+
+  // Skip cranking, which isn't the hot path
+  State_t state = state_store_get(bench_store);
+  if (!state.running || state.cranking) return;
+
+  bench_stats[kind].calls++;
+  bench_stats[kind].total_ns += elapsed;
+  bench_stats[kind].max_ns = MAX(bench_stats[kind].max_ns, elapsed);
+}
+
+/** Stands in for the trigger's edge IRQ handler, and times it */
+static void bench_trigger_irq() {
+  uint64_t start = bench_now_ns();
+  bench_trigger_irq_handler();
+  bench_record(BENCH_TRIGGER_EDGE, bench_now_ns() - start);
+}
+
+static double bench_rpm(void* context, double t) {
+  return *(double*) context;
+}
+
+/** What `tick_to_absolute_time` used to be */
+static inline absolute_time_t bench_tick_to_absolute_time_64(tick_t tick) {
+  return from_us_since_boot((int64_t) time_us_64() + tick_diff(tick, tick_now()));
+}
+
+static void bench_conversion() {
+  volatile absolute_time_t sink;
+  tick_t tick = tick_now();
+
+  uint64_t start = bench_now_ns();
+  for (uint32_t i = 0; i < BENCH_CONVERSIONS; ++i) {
+    sink = bench_tick_to_absolute_time_64(tick + i);
+  }
+  uint64_t wide = bench_now_ns() - start;
+
+  start = bench_now_ns();
+  for (uint32_t i = 0; i < BENCH_CONVERSIONS; ++i) {
+    sink = tick_to_absolute_time(tick + i);
+  }
+  uint64_t narrow = bench_now_ns() - start;
+  (void) sink;
+
+  printf("\nTick to absolute time (ns per call)\n");
+  printf("  %-30s %8.2f\n", "time_us_64 + diff", wide / (double) BENCH_CONVERSIONS);
+  printf("  %-30s %8.2f\n", "raw reads + 64-bit add", narrow / (double) BENCH_CONVERSIONS);
+}
+
+int main(int argc, char** argv) {
+  double rpm = 6000;
+  double seconds = 20;
+  int option;
+
+  while ((option = getopt(argc, argv, "r:s:")) != -1) {
+    switch (option) {
+      case 'r': rpm = strtod(optarg, NULL); break;
+      case 's': seconds = strtod(optarg, NULL); break;
+      default:
+        fprintf(stderr, "usage: %s [-r rpm] [-s seconds]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  tune_init(TIMING_STATIC_VALUE, IGN_DWELL_US, TUNE_RPM_MAX);
+
+  // No alarm latency, so what's timed is only the callbacks
+  sim_engine_config_t config = {
+    .timing = timing_mapped,
+    .dwell = dwell_mapped,
+    .trigger_degrees = 45,
+    .rpm = bench_rpm,
+    .rpm_context = &rpm
+  };
+  sim_engine_t engine;
+  sim_engine_init(&engine, &config);
+  bench_store = engine.store;
+  bench_trigger_irq_handler = sim_gpio_irq_handlers[TRIGGER_PIN];
+  sim_gpio_irq_handlers[TRIGGER_PIN] = bench_trigger_irq;
+
+  // Clock readings cost something too. Take that off of every call.
+  bench_overhead_ns = bench_now_ns();
+  for (int i = 0; i < 1000; ++i) bench_now_ns();
+  bench_overhead_ns = (bench_now_ns() - bench_overhead_ns) / 1001;
+
+  while (sim_engine_next(&engine, seconds)) {
+    scheduled_event_t* item = sim_alarm_due_data();
+    bool trigger = item->event.what == trigger_event_callback;
+    bool coil = gpio_get(IGN_COIL_PIN);
+
+    uint64_t start = bench_now_ns();
+    sim_alarm_fire();
+    uint64_t elapsed = bench_now_ns() - start;
+
+    bench_kind_t kind;
+    if (trigger) {
+      kind = BENCH_TRIGGER_STALL_CHECK;
+    } else if (coil != gpio_get(IGN_COIL_PIN)) {
+      kind = coil ? BENCH_SPARK : BENCH_DWELL_START;
+    } else {
+      kind = BENCH_SPARK_POLL;
+    }
+    bench_record(kind, elapsed);
+  }
+
+  printf("%.0f rpm for %.0fs, mapped timing, trigger 45 BTDC\n", rpm, seconds);
+  printf("\nCallbacks (ns per call)\n  %-30s %10s %8s %8s\n", "", "calls", "mean", "max");
+  for (int kind = 0; kind < BENCH_KINDS; ++kind) {
+    bench_stats_t* stats = &bench_stats[kind];
+    double mean = stats->calls ? stats->total_ns / (double) stats->calls : 0;
+    printf("  %-30s %10llu %8.1f %8llu\n", BENCH_NAMES[kind],
+      (unsigned long long) stats->calls, mean, (unsigned long long) stats->max_ns);
+  }
+
+  bench_conversion();
+  return 0;
+}
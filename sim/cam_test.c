@@ -0,0 +1,171 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Host test for cam sync. Runs one simulated engine (see engine.h) and checks that the phase is
+ * only trusted after TRIGGER_CAM_CONFIRM_CYCLES cam edges in place, that it drops back to wasted
+ * spark when the cam edge goes missing or moves, and that sequential spark fires half as often.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pico/stdlib.h>
+#include "config.h"
+#include "engine.h"
+#include "tune.h"
+#include "test.h"
+
+#ifndef CAM_PIN
+#error "The cam test needs a profile with a CAM_PIN"
+#endif
+
+#define TEST_RPM 3000
+/** Longest the engine is left to get to the next crank edge */
+#define TEST_EDGE_TIMEOUT_S 0.5
+/** Long enough for a few hundred engine cycles */
+#define TEST_SPARK_WINDOW_S 10.0
+
+static double test_rpm(void* context, double t) {
+  return TEST_RPM;
+}
+
+static void test_engine_init(sim_engine_t* engine) {
+  sim_engine_config_t config = {
+    .timing = timing_static,
+    .trigger_degrees = 45,
+    .rpm = test_rpm
+  };
+  sim_engine_init(engine, &config);
+}
+
+/**
+ * Run to the next crank edge the trigger picks up. Returns false if there wasn't one. `tdc` is
+ * where the TDC the new state predicts sits on the crank, modulo 720.
+ */
+static bool test_next_edge(sim_engine_t* engine, State_t* state, double* tdc) {
+  engine_clock_t clock = state_store_get(engine->store).clock;
+  double until = engine->elapsed * 1e-6 + TEST_EDGE_TIMEOUT_S;
+
+  while (sim_engine_next(engine, until)) {
+    sim_alarm_fire();
+    *state = state_store_get(engine->store);
+    if (state->running && state->clock != clock) {
+      // Edge k sits at 360k - trigger_degrees, and predicts TDC k + 1
+      double edges = floor((engine->theta + engine->config.trigger_degrees) / 360);
+      *tdc = fmod(360 * (edges + 1), 720);
+      return true;
+    }
+  }
+  return false;
+}
+
+/** Crank edges until the cam is synced, or -1 if it isn't within `limit` */
+static int test_edges_to_sync(sim_engine_t* engine, int limit) {
+  State_t state;
+  double tdc;
+  for (int edges = 1; edges <= limit; ++edges) {
+    if (!test_next_edge(engine, &state, &tdc)) return -1;
+    if (state.cam_synced) return edges;
+  }
+  return -1;
+}
+
+/** Crank edges until sync is lost, or -1 if it isn't within `limit` */
+static int test_edges_to_loss(sim_engine_t* engine, int limit) {
+  State_t state;
+  double tdc;
+  for (int edges = 1; edges <= limit; ++edges) {
+    if (!test_next_edge(engine, &state, &tdc)) return -1;
+    if (!state.cam_synced) return edges;
+  }
+  return -1;
+}
+
+/** Check every synced edge predicts phase 0 for the TDC at `compression`, for `count` edges */
+static void test_phase(sim_engine_t* engine, double compression, int count) {
+  State_t state;
+  double tdc;
+  for (int i = 0; i < count; ++i) {
+    if (!test_next_edge(engine, &state, &tdc)) {
+      CHECK(false, "engine stopped");
+      return;
+    }
+    CHECK(state.cam_synced, "sync lost on a steady engine");
+    bool compression_tdc = tdc == compression;
+    CHECK((state.phase == 0) == compression_tdc, "phase %u predicted for the TDC at %.0f", state.phase, tdc);
+  }
+}
+
+/** Sparks per second over the next TEST_SPARK_WINDOW_S */
+static double test_spark_rate(sim_engine_t* engine) {
+  uint64_t sparks = engine->stats.sparks;
+  sim_engine_run(engine, engine->elapsed * 1e-6 + TEST_SPARK_WINDOW_S);
+  return (engine->stats.sparks - sparks) / TEST_SPARK_WINDOW_S;
+}
+
+static void test_sync() {
+  sim_engine_t engine;
+  test_engine_init(&engine);
+
+  // The first cam edge only lines the phase up. Then it has to be seen in place enough times.
+  int edges = test_edges_to_sync(&engine, 8 * TRIGGER_EDGES_PER_CYCLE);
+  CHECK(edges > TRIGGER_CAM_CONFIRM_CYCLES * TRIGGER_EDGES_PER_CYCLE, "synced after %d crank edges", edges);
+  CHECK(edges > 0 && edges <= (TRIGGER_CAM_CONFIRM_CYCLES + 2) * TRIGGER_EDGES_PER_CYCLE, "synced after %d crank edges", edges);
+
+  test_phase(&engine, 0, 4 * TRIGGER_EDGES_PER_CYCLE);
+
+  // Sequential: one spark per engine cycle, half as many as wasted spark
+  double rate = test_spark_rate(&engine);
+  CHECK(fabs(rate - TEST_RPM / 120.0) < 1, "%.1f sparks/s synced at %d rpm", rate, TEST_RPM);
+}
+
+static void test_missing_cam() {
+  sim_engine_t engine;
+  test_engine_init(&engine);
+  test_edges_to_sync(&engine, 8 * TRIGGER_EDGES_PER_CYCLE);
+
+  // Without the cam, sync goes at the next edge that should have had one
+  engine.cam = false;
+  int edges = test_edges_to_loss(&engine, 4 * TRIGGER_EDGES_PER_CYCLE);
+  CHECK(edges > 0 && edges <= TRIGGER_EDGES_PER_CYCLE, "sync lost %d crank edges after the cam", edges);
+
+  // And every TDC gets a spark again
+  double rate = test_spark_rate(&engine);
+  CHECK(fabs(rate - TEST_RPM / 60.0) < 1, "%.1f sparks/s without the cam at %d rpm", rate, TEST_RPM);
+
+  // Until it comes back
+  engine.cam = true;
+  edges = test_edges_to_sync(&engine, 8 * TRIGGER_EDGES_PER_CYCLE);
+  CHECK(edges > 0, "never synced again once the cam came back");
+  test_phase(&engine, 0, 4 * TRIGGER_EDGES_PER_CYCLE);
+}
+
+static void test_misplaced_cam() {
+  sim_engine_t engine;
+  test_engine_init(&engine);
+  test_edges_to_sync(&engine, 8 * TRIGGER_EDGES_PER_CYCLE);
+
+  // A cam edge a revolution out of place, as if it skipped a tooth on the cam belt
+  engine.cam_degrees = fmod(engine.cam_degrees + 360, 720);
+  int edges = test_edges_to_loss(&engine, 4 * TRIGGER_EDGES_PER_CYCLE);
+  CHECK(edges > 0 && edges <= TRIGGER_EDGES_PER_CYCLE, "sync lost %d crank edges after moving the cam", edges);
+
+  // Seen there steadily, it's the new phase
+  edges = test_edges_to_sync(&engine, 8 * TRIGGER_EDGES_PER_CYCLE);
+  CHECK(edges > TRIGGER_CAM_CONFIRM_CYCLES * TRIGGER_EDGES_PER_CYCLE - TRIGGER_EDGES_PER_CYCLE, "synced %d crank edges after moving the cam", edges);
+  test_phase(&engine, 360, 4 * TRIGGER_EDGES_PER_CYCLE);
+}
+
+int main() {
+  tune_init(TIMING_STATIC_VALUE, IGN_DWELL_US, TUNE_RPM_MAX);
+
+  test_sync();
+  test_missing_cam();
+  test_misplaced_cam();
+
+  return test_result();
+}
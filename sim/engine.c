@@ -0,0 +1,271 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <pico/stdlib.h>
+#include <pico/time.h>
+#include <hardware/structs/timer.h>
+#include "engine.h"
+#include "config.h"
+
+/** Starting tick. Close to the wrap, so every run crosses it */
+#define SIM_TICK_START (UINT32_MAX - 2000000u)
+
+/** Longest the crank model is integrated over in one go */
+#define SIM_STEP_US 20
+
+/** Degrees per µs at one RPM */
+#define SIM_DEGREES_PER_US_RPM (360.0 / 60e6)
+
+#define SIM_TRIGGER_WIDTH_DEGREES 10
+#define SIM_CAM_WIDTH_DEGREES 30
+#define SIM_CAM_LEAD_DEGREES 90
+
+/** The engine the calling thread is running, for the pin hook */
+static _Thread_local sim_engine_t* sim_engine_current;
+
+static inline uint32_t sim_random(uint32_t* seed) {
+  // xorshift32
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 17;
+  *seed ^= *seed << 5;
+  return *seed;
+}
+
+/** Uniform in [-1, 1] */
+static inline double sim_random_unit(uint32_t* seed) {
+  return sim_random(seed) / (double) UINT32_MAX * 2 - 1;
+}
+
+static inline void sim_set_clock(uint64_t elapsed) {
+  uint64_t now = SIM_TICK_START + elapsed;
+  timer_hw->timerawh = now >> 32;
+  timer_hw->timerawl = now;
+}
+
+static void sim_spark(sim_engine_t* engine) {
+  tick_t now = timer_hw->timerawl;
+  sim_plan_t* match = NULL;
+  tick_diff_t best = 0;
+
+  // The plan this spark was for is the one planned closest to now
+  for (uint8_t i = 0; i < SIM_ENGINE_PLANS; ++i) {
+    sim_plan_t* plan = &engine->plans[i];
+    if (plan->physical_period == 0 || plan->fired) continue;
+    tick_diff_t diff = tick_diff(now, plan->spark);
+    diff = diff < 0 ? -diff : diff;
+    if (diff < (tick_diff_t) (plan->physical_period / 4) && (!match || diff < best)) {
+      match = plan;
+      best = diff;
+    }
+  }
+
+  if (!match) {
+    engine->stats.unplanned++;
+    return;
+  }
+
+  match->fired = true;
+  double error = (match->tdc_degrees - engine->theta) - match->advance;
+  engine->stats.sparks++;
+  engine->stats.sum += error;
+  engine->stats.sum_squares += error * error;
+  engine->stats.max_abs = MAX(engine->stats.max_abs, fabs(error));
+  engine->stats.max_advance = MAX(engine->stats.max_advance, error);
+}
+
+static void sim_gpio_put(unsigned int gpio, bool value) {
+  sim_engine_t* engine = sim_engine_current;
+  if (gpio != IGN_COIL_PIN) return;
+  if (engine->coil && !value) {
+    sim_spark(engine);
+  }
+  engine->coil = value;
+}
+
+/** Planned sparks whose time has long gone without the coil firing */
+static inline void sim_plan_retire(sim_engine_t* engine, sim_plan_t* plan) {
+  if (plan->physical_period && !plan->fired) {
+    engine->stats.missed++;
+  }
+}
+
+/** After `ignition_plan_listener`: remember what the spark path was told to do */
+static void sim_plan_listener(State_t* state, void* param) {
+  sim_engine_t* engine = param;
+  const ignition_plan_t* plan = ignition_get_plan(engine->ignition);
+  if (!state->running || state->cranking || plan->clock == engine->planned_clock) {
+    return;
+  }
+  engine->planned_clock = plan->clock;
+  if (plan->cut) {
+    engine->stats.cut++;
+    return;
+  }
+
+  // Edge k sits at 360k - trigger_degrees, and the plan made on it aims at TDC k + 1
+  double edges = floor((engine->theta + engine->config.trigger_degrees) / 360);
+  sim_plan_t* slot = &engine->plans[engine->next_plan];
+  engine->next_plan = (engine->next_plan + 1) % SIM_ENGINE_PLANS;
+  sim_plan_retire(engine, slot);
+  *slot = (sim_plan_t) {
+    .spark = plan->spark,
+    .advance = plan->advance,
+    .tdc_degrees = 360 * (edges + 1),
+    .physical_period = state->physical_period,
+    .fired = false
+  };
+}
+
+/** Core0's doorbell. Core1 picks up the new cycle straight away. */
+static void sim_doorbell_listener(State_t* state, void* param) {
+  sim_engine_t* engine = param;
+  scheduler_refresh(engine->core1, state);
+}
+
+/** Crank degrees to the next change on the trigger or cam pin */
+static double sim_degrees_to_edge(sim_engine_t* engine) {
+  double trigger = fmod(engine->theta + engine->config.trigger_degrees, 360);
+  double degrees = trigger < SIM_TRIGGER_WIDTH_DEGREES ? SIM_TRIGGER_WIDTH_DEGREES - trigger : 360 - trigger;
+#ifdef CAM_PIN
+  double cam = engine->theta - engine->cam_degrees;
+  if (cam < 0) {
+    degrees = MIN(degrees, -cam);
+  } else {
+    cam = fmod(cam, 720);
+    degrees = MIN(degrees, cam < SIM_CAM_WIDTH_DEGREES ? SIM_CAM_WIDTH_DEGREES - cam : 720 - cam);
+  }
+#endif
+  return degrees;
+}
+
+static void sim_update_pins(sim_engine_t* engine) {
+  double trigger = engine->theta + engine->config.trigger_degrees;
+  gpio_put(TRIGGER_PIN, trigger >= 360 && fmod(trigger, 360) < SIM_TRIGGER_WIDTH_DEGREES);
+#ifdef CAM_PIN
+  double cam = engine->theta - engine->cam_degrees;
+  gpio_put(CAM_PIN, engine->cam && cam >= 0 && fmod(cam, 720) < SIM_CAM_WIDTH_DEGREES);
+#endif
+}
+
+/**
+ * Move the crank on to `elapsed`, or to the first µs a pin changes at, whichever comes first.
+ * Returns false if it stopped on a pin change: its IRQ may have asked for an earlier alarm.
+ */
+static bool sim_advance(sim_engine_t* engine, uint64_t elapsed) {
+  while (engine->elapsed < elapsed) {
+    uint32_t step = MIN(elapsed - engine->elapsed, SIM_STEP_US);
+    double t = engine->elapsed * 1e-6;
+    double rpm = engine->config.rpm(engine->config.rpm_context, t)
+      * (1 + engine->jitter)
+      * (1 + engine->config.ripple * sin(engine->theta * M_PI / 180));
+    double degrees_per_us = rpm * SIM_DEGREES_PER_US_RPM;
+
+    // Land on the µs the edge is in, not somewhere in the step after it
+    double to_edge = sim_degrees_to_edge(engine);
+    bool edge = degrees_per_us * step >= to_edge;
+    if (edge) {
+      step = MAX(ceil(to_edge / degrees_per_us), 1);
+    }
+    engine->theta += degrees_per_us * step;
+    engine->elapsed += step;
+
+    uint64_t revolution = engine->theta / 360;
+    if (revolution != engine->revolution) {
+      engine->revolution = revolution;
+      engine->jitter = engine->config.jitter * sim_random_unit(&engine->config.seed);
+    }
+
+    if (edge) {
+      sim_set_clock(engine->elapsed);
+      sim_update_pins(engine);
+      return false;
+    }
+  }
+  sim_set_clock(engine->elapsed);
+  sim_update_pins(engine);
+  return true;
+}
+
+void sim_engine_init(sim_engine_t* engine, const sim_engine_config_t* config) {
+  memset(engine, 0, sizeof(*engine));
+  engine->config = *config;
+  engine->cam = true;
+  engine->cam_degrees = fmod(720 + 360 - config->trigger_degrees - SIM_CAM_LEAD_DEGREES, 720);
+
+  // Fresh hardware for this engine
+  sim_gpio_reset();
+  sim_set_clock(0);
+  sim_alarm_reset(config->latency_us, config->cost_us);
+  sim_engine_current = engine;
+  sim_gpio_put_hook = sim_gpio_put;
+
+  engine->store = state_store_init();
+  engine->trigger = trigger_init(config->trigger_degrees);
+  trigger_set_state_store(engine->trigger, engine->store);
+  engine->ignition = ignition_init(config->timing);
+  ignition_set_state_store(engine->ignition, engine->store);
+  ignition_set_dwell_func(engine->ignition, config->dwell);
+
+  engine->core0 = scheduler_init(SCHEDULER_0_ALARM);
+  scheduler_set_state_store(engine->core0, engine->store);
+  engine->core1 = scheduler_init(SCHEDULER_1_ALARM);
+  scheduler_set_state_store(engine->core1, engine->store);
+
+  // Same order as the firmware: plan, then the doorbell
+  state_store_add_listener(engine->store, ignition_plan_listener, engine->ignition);
+  state_store_add_listener(engine->store, sim_plan_listener, engine);
+  state_store_add_listener(engine->store, sim_doorbell_listener, engine);
+
+  scheduler_add_event(engine->core0, scheduler_event_init(trigger_event_callback, RELATIVE_US, -1, TRIGGER_EVENT_PERIOD, engine->trigger));
+  scheduler_add_event(engine->core1, scheduler_event_init(ignition_event_callback, RELATIVE_US, -1, IGN_CRANK_POLL_US, engine->ignition));
+}
+
+bool sim_engine_next(sim_engine_t* engine, double seconds) {
+  uint64_t until = seconds * 1e6;
+  absolute_time_t at;
+  bool due;
+
+  do {
+    due = sim_alarm_next(SIM_TICK_START + until, &at);
+  } while (!sim_advance(engine, due ? at - SIM_TICK_START : until));
+  return due;
+}
+
+void sim_engine_run(sim_engine_t* engine, double seconds) {
+  while (sim_engine_next(engine, seconds)) {
+    sim_alarm_fire();
+  }
+}
+
+void sim_engine_finish(sim_engine_t* engine) {
+  for (uint8_t i = 0; i < SIM_ENGINE_PLANS; ++i) {
+    sim_plan_t* plan = &engine->plans[i];
+    // Still to come when the run ended isn't a miss
+    if (tick_after(plan->spark, timer_hw->timerawl)) continue;
+    sim_plan_retire(engine, plan);
+    plan->physical_period = 0;
+  }
+
+  engine->stats.late = scheduler_late(engine->core0) + scheduler_late(engine->core1);
+  engine->stats.overflows = scheduler_overflows(engine->core0) + scheduler_overflows(engine->core1);
+  engine->stats.short_dwells = ignition_short_dwells(engine->ignition);
+}
+
+void sim_stats_add(sim_stats_t* stats, const sim_stats_t* other) {
+  stats->sparks += other->sparks;
+  stats->cut += other->cut;
+  stats->missed += other->missed;
+  stats->unplanned += other->unplanned;
+  stats->sum += other->sum;
+  stats->sum_squares += other->sum_squares;
+  stats->max_abs = MAX(stats->max_abs, other->max_abs);
+  stats->max_advance = MAX(stats->max_advance, other->max_advance);
+  stats->late += other->late;
+  stats->overflows += other->overflows;
+  stats->short_dwells += other->short_dwells;
+}
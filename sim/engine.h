@@ -0,0 +1,128 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_ENGINE_H
+#define SIM_ENGINE_H
+
+#include <pico/stdlib.h>
+#include "state.h"
+#include "scheduler.h"
+#include "trigger.h"
+#include "ignition.h"
+#include "timing.h"
+
+/** Planned sparks kept around for matching against the coil pin */
+#define SIM_ENGINE_PLANS 4
+
+/** Mean RPM asked for at `t` seconds into the run */
+typedef double (*sim_rpm_func_t)(void* context, double t);
+
+typedef struct sim_engine_config {
+  timing_func_t timing;
+  dwell_func_t dwell;
+  /** Where the trigger sits, in degrees before TDC */
+  float trigger_degrees;
+  /** Speed swing within a revolution from the power stroke, as a fraction of RPM */
+  float ripple;
+  /** Random revolution to revolution variation, as a fraction of RPM */
+  float jitter;
+  uint32_t seed;
+  /** Alarms fire this long after they're due */
+  uint32_t latency_us;
+  /** And keep their core busy for this long */
+  uint32_t cost_us;
+  sim_rpm_func_t rpm;
+  void* rpm_context;
+} sim_engine_config_t;
+
+/** Spark angle error statistics, in degrees. Positive is over-advanced. */
+typedef struct sim_stats {
+  uint64_t sparks;
+  uint64_t cut;
+  /** Planned sparks the coil never fired */
+  uint64_t missed;
+  /** Sparks without a plan: cranking, fired straight off the trigger */
+  uint64_t unplanned;
+  double sum;
+  double sum_squares;
+  double max_abs;
+  /** Furthest over-advanced, the direction that hurts the engine. 0 if never. */
+  double max_advance;
+  /** Scheduler and ignition counters, both cores */
+  uint64_t late;
+  uint64_t overflows;
+  uint64_t short_dwells;
+} sim_stats_t;
+
+typedef struct sim_plan {
+  tick_t spark;
+  float advance;
+  double tdc_degrees;
+  uint32_t physical_period;
+  bool fired;
+} sim_plan_t;
+
+/**
+ * One engine running the firmware's own trigger, schedulers and ignition against a crank model,
+ * on the calling thread. Core0's scheduler polls the trigger and core1's runs the spark path,
+ * with the doorbell as a state listener. Alarms go through the host alarm pools, so they fire
+ * late and queue up behind each other like on the chip, and every fall of the coil pin is
+ * checked against where the crank was at that moment.
+ *
+ * The cam, when the profile has one, pulses 90 degrees ahead of the trigger edge before each
+ * compression TDC. Compression TDCs are at multiples of 720 degrees.
+ */
+typedef struct sim_engine {
+  sim_engine_config_t config;
+  StateStore_t store;
+  Trigger_t trigger;
+  Ignition_t ignition;
+  Scheduler_t core0;
+  Scheduler_t core1;
+
+  /** µs since the start of the run */
+  uint64_t elapsed;
+  double theta;
+  double jitter;
+  uint64_t revolution;
+
+  /** Drive the cam pin at all, and where its pulse starts within the 720 degree cycle */
+  bool cam;
+  double cam_degrees;
+
+  bool coil;
+  engine_clock_t planned_clock;
+  sim_plan_t plans[SIM_ENGINE_PLANS];
+  uint8_t next_plan;
+  sim_stats_t stats;
+} sim_engine_t;
+
+/**
+ * Build the engine's firmware instances and start it at TDC, stopped. Resets the calling
+ * thread's pins, clock and alarm pools.
+ */
+void sim_engine_init(sim_engine_t* engine, const sim_engine_config_t* config);
+
+/**
+ * Run up to `seconds` into the run. Can be called again to carry on, after changing `cam`.
+ */
+void sim_engine_run(sim_engine_t* engine, double seconds);
+
+/**
+ * Move the engine up to the next alarm due by `seconds` into the run, and stop right before
+ * `sim_alarm_fire` runs it. Once none is, moves up to `seconds` and returns false.
+ */
+bool sim_engine_next(sim_engine_t* engine, double seconds);
+
+/**
+ * Wrap up the statistics: count planned sparks that never came, and pick up the firmware's
+ * counters
+ */
+void sim_engine_finish(sim_engine_t* engine);
+
+void sim_stats_add(sim_stats_t* stats, const sim_stats_t* other);
+
+#endif
@@ -0,0 +1,33 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_HOST_HARDWARE_ADC_H
+#define SIM_HOST_HARDWARE_ADC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define DREQ_ADC 36
+
+typedef struct {
+  volatile uint32_t fifo;
+} adc_hw_t;
+
+extern _Thread_local adc_hw_t sim_adc_hw;
+#define adc_hw (&sim_adc_hw)
+
+/** Analog triggers aren't simulated, engines use the digital trigger */
+static inline void adc_gpio_init(unsigned int gpio) {}
+static inline void adc_select_input(unsigned int input) {}
+static inline uint16_t adc_read() { return 0; }
+
+/** Knock windows run the ADC into DMA. Nothing is sampled, windows close empty. */
+static inline void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh, bool err_in_fifo, bool byte_shift) {}
+static inline void adc_set_clkdiv(float clkdiv) {}
+static inline void adc_run(bool run) {}
+static inline void adc_fifo_drain() {}
+
+#endif
@@ -0,0 +1,52 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_HOST_HARDWARE_DMA_H
+#define SIM_HOST_HARDWARE_DMA_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_DMA_CHANNELS 12
+
+enum dma_channel_transfer_size {DMA_SIZE_8, DMA_SIZE_16, DMA_SIZE_32};
+
+typedef struct {
+  uint32_t ctrl;
+} dma_channel_config;
+
+typedef struct {
+  volatile uint32_t transfer_count;
+} dma_channel_hw_t;
+
+/** Channels of the calling thread's engine. Nothing ever gets transferred. */
+extern _Thread_local dma_channel_hw_t sim_dma_hw[SIM_DMA_CHANNELS];
+extern _Thread_local uint32_t sim_dma_claimed;
+
+static inline int dma_claim_unused_channel(bool required) {
+  for (int channel = 0; channel < SIM_DMA_CHANNELS; ++channel) {
+    if (!(sim_dma_claimed & (1u << channel))) {
+      sim_dma_claimed |= 1u << channel;
+      return channel;
+    }
+  }
+  return -1;
+}
+
+static inline dma_channel_hw_t* dma_channel_hw_addr(unsigned int channel) { return &sim_dma_hw[channel]; }
+static inline dma_channel_config dma_channel_get_default_config(unsigned int channel) { return (dma_channel_config) { 0 }; }
+static inline void channel_config_set_transfer_data_size(dma_channel_config* config, enum dma_channel_transfer_size size) {}
+static inline void channel_config_set_read_increment(dma_channel_config* config, bool increment) {}
+static inline void channel_config_set_write_increment(dma_channel_config* config, bool increment) {}
+static inline void channel_config_set_dreq(dma_channel_config* config, unsigned int dreq) {}
+static inline void dma_channel_abort(unsigned int channel) {}
+
+static inline void dma_channel_configure(unsigned int channel, const dma_channel_config* config,
+    volatile void* write_addr, const volatile void* read_addr, uint32_t transfer_count, bool trigger) {
+  sim_dma_hw[channel].transfer_count = transfer_count;
+}
+
+#endif
@@ -0,0 +1,24 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_HOST_HARDWARE_FLASH_H
+#define SIM_HOST_HARDWARE_FLASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#define FLASH_PAGE_SIZE 256
+#define FLASH_SECTOR_SIZE 4096
+#define XIP_BASE ((uintptr_t) sim_flash)
+
+/** Shared by every engine. Blank, so nothing saved is ever found. */
+extern uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+static inline void flash_range_erase(uint32_t offset, size_t count) { memset(&sim_flash[offset], 0xFF, count); }
+static inline void flash_range_program(uint32_t offset, const uint8_t* data, size_t count) { memcpy(&sim_flash[offset], data, count); }
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_HOST_HARDWARE_GPIO_H
+#define SIM_HOST_HARDWARE_GPIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_GPIO_COUNT 30
+#define GPIO_IN false
+#define GPIO_OUT true
+#define GPIO_IRQ_EDGE_FALL 0x4u
+#define GPIO_IRQ_EDGE_RISE 0x8u
+
+/** Pin levels of the calling thread's engine */
+extern _Thread_local bool sim_gpio[SIM_GPIO_COUNT];
+/** Called on every `gpio_put` of the calling thread's engine, if set */
+extern _Thread_local void (*sim_gpio_put_hook)(unsigned int gpio, bool value);
+/** Raw IRQ handlers, and the edge events enabled and latched, per pin */
+extern _Thread_local void (*sim_gpio_irq_handlers[SIM_GPIO_COUNT])();
+extern _Thread_local uint32_t sim_gpio_irq_enabled[SIM_GPIO_COUNT];
+extern _Thread_local uint32_t sim_gpio_irq_events[SIM_GPIO_COUNT];
+
+/** Latch the edge, and call the pin's handler if it's enabled, like the IO bank IRQ would */
+void sim_gpio_edge(unsigned int gpio, bool value);
+
+/** Fresh pins for a new engine: all low, no handlers */
+void sim_gpio_reset();
+
+static inline void gpio_init(unsigned int gpio) { sim_gpio[gpio] = false; }
+static inline void gpio_set_dir(unsigned int gpio, bool out) {}
+static inline void gpio_pull_down(unsigned int gpio) {}
+static inline void gpio_put(unsigned int gpio, bool value) {
+  bool previous = sim_gpio[gpio];
+  sim_gpio[gpio] = value;
+  if (sim_gpio_put_hook) sim_gpio_put_hook(gpio, value);
+  if (value != previous) sim_gpio_edge(gpio, value);
+}
+static inline bool gpio_get(unsigned int gpio) { return sim_gpio[gpio]; }
+
+/** Edge interrupts run the handler straight from `gpio_put`, with no latency */
+static inline void gpio_add_raw_irq_handler(unsigned int gpio, void (*handler)()) {
+  sim_gpio_irq_handlers[gpio] = handler;
+}
+static inline void gpio_set_irq_enabled(unsigned int gpio, uint32_t events, bool enabled) {
+  sim_gpio_irq_enabled[gpio] = enabled ? sim_gpio_irq_enabled[gpio] | events : sim_gpio_irq_enabled[gpio] & ~events;
+}
+static inline void gpio_acknowledge_irq(unsigned int gpio, uint32_t events) {
+  sim_gpio_irq_events[gpio] &= ~events;
+}
+static inline uint32_t gpio_get_irq_event_mask(unsigned int gpio) {
+  return sim_gpio_irq_events[gpio] & sim_gpio_irq_enabled[gpio];
+}
+
+#endif
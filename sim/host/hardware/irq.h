@@ -0,0 +1,17 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_HOST_HARDWARE_IRQ_H
+#define SIM_HOST_HARDWARE_IRQ_H
+
+#include <stdbool.h>
+
+#define IO_IRQ_BANK0 13
+
+/** GPIO handlers are called straight from `gpio_put`, so there's nothing to enable */
+static inline void irq_set_enabled(unsigned int num, bool enabled) {}
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_HOST_HARDWARE_STRUCTS_TIMER_H
+#define SIM_HOST_HARDWARE_STRUCTS_TIMER_H
+
+#include <stdint.h>
+
+typedef struct {
+  uint32_t timerawh;
+  uint32_t timerawl;
+} timer_hw_t;
+
+/** Virtual µs clock of the calling thread's engine. The simulator advances it. */
+extern _Thread_local timer_hw_t sim_timer_hw;
+
+#define timer_hw (&sim_timer_hw)
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <string.h>
+#include <pico/stdlib.h>
+#include <hardware/structs/timer.h>
+#include <hardware/structs/systick.h>
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+#include <hardware/flash.h>
+#include <pico/time.h>
+#include "arena.h"
+#include "traction.h"
+
+_Thread_local timer_hw_t sim_timer_hw;
+_Thread_local systick_hw_t sim_systick_hw;
+_Thread_local bool sim_gpio[SIM_GPIO_COUNT];
+_Thread_local void (*sim_gpio_put_hook)(unsigned int gpio, bool value);
+_Thread_local void (*sim_gpio_irq_handlers[SIM_GPIO_COUNT])();
+_Thread_local uint32_t sim_gpio_irq_enabled[SIM_GPIO_COUNT];
+_Thread_local uint32_t sim_gpio_irq_events[SIM_GPIO_COUNT];
+
+void sim_gpio_edge(unsigned int gpio, bool value) {
+  sim_gpio_irq_events[gpio] |= value ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+  if (sim_gpio_irq_handlers[gpio] && gpio_get_irq_event_mask(gpio)) {
+    sim_gpio_irq_handlers[gpio]();
+  }
+}
+
+void sim_gpio_reset() {
+  memset(sim_gpio, 0, sizeof(sim_gpio));
+  memset(sim_gpio_irq_handlers, 0, sizeof(sim_gpio_irq_handlers));
+  memset(sim_gpio_irq_enabled, 0, sizeof(sim_gpio_irq_enabled));
+  memset(sim_gpio_irq_events, 0, sizeof(sim_gpio_irq_events));
+}
+_Thread_local adc_hw_t sim_adc_hw;
+_Thread_local dma_channel_hw_t sim_dma_hw[SIM_DMA_CHANNELS];
+_Thread_local uint32_t sim_dma_claimed;
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+#define SIM_ALARM_POOLS 4
+#define SIM_ALARM_MAX_TIMERS 8
+
+typedef struct sim_alarm {
+  bool active;
+  alarm_id_t id;
+  alarm_pool_t* pool;
+  absolute_time_t time;
+  alarm_callback_t callback;
+  void* user_data;
+} sim_alarm_t;
+
+struct alarm_pool {
+  sim_alarm_t alarms[SIM_ALARM_MAX_TIMERS];
+  unsigned int max_timers;
+  /** Its core is running a callback until then */
+  absolute_time_t busy_until;
+};
+
+static _Thread_local alarm_pool_t sim_alarm_pools[SIM_ALARM_POOLS];
+static _Thread_local unsigned int sim_alarm_pool_count;
+static _Thread_local uint32_t sim_alarm_latency_us;
+static _Thread_local uint32_t sim_alarm_cost_us;
+static _Thread_local alarm_id_t sim_alarm_last_id;
+static _Thread_local sim_alarm_t* sim_alarm_due;
+
+/**
+ * Stands in for the per-core arenas, which only have room for one engine. Simulated engines are
+ * built once per run and live until the process exits, so nothing is freed here either.
+ */
+void* arena_alloc(size_t size) {
+  void* memory = calloc(1, size);
+  if (!memory) {
+    panic("out of memory allocating %zu bytes", size);
+  }
+  return memory;
+}
+
+size_t arena_high_water(uint core) {
+  return 0;
+}
+
+/** Wheel speeds need PIO. Simulated engines don't have wheels. */
+limiter_action_t traction_evaluate(Traction_t tc) {
+  limiter_action_t action = { .cut = false, .retard_degrees = 0 };
+  return action;
+}
+
+alarm_pool_t* alarm_pool_create(unsigned int hardware_alarm_num, unsigned int max_timers) {
+  if (sim_alarm_pool_count == SIM_ALARM_POOLS || max_timers > SIM_ALARM_MAX_TIMERS) {
+    panic("no room for alarm pool %u", hardware_alarm_num);
+  }
+  alarm_pool_t* pool = &sim_alarm_pools[sim_alarm_pool_count++];
+  memset(pool, 0, sizeof(*pool));
+  pool->max_timers = max_timers;
+  return pool;
+}
+
+alarm_id_t alarm_pool_add_alarm_at(alarm_pool_t* pool, absolute_time_t time, alarm_callback_t callback,
+    void* user_data, bool fire_if_past) {
+  if (fire_if_past && time <= time_us_64()) {
+    // Like the SDK: run it right here and report that there's nothing to wait for
+    callback(0, user_data);
+    return 0;
+  }
+  for (unsigned int i = 0; i < pool->max_timers; ++i) {
+    sim_alarm_t* alarm = &pool->alarms[i];
+    if (alarm->active) continue;
+    alarm->active = true;
+    alarm->id = ++sim_alarm_last_id;
+    alarm->pool = pool;
+    alarm->time = time;
+    alarm->callback = callback;
+    alarm->user_data = user_data;
+    return alarm->id;
+  }
+  return -1;
+}
+
+void sim_alarm_reset(uint32_t latency_us, uint32_t cost_us) {
+  sim_alarm_pool_count = 0;
+  sim_alarm_latency_us = latency_us;
+  sim_alarm_cost_us = cost_us;
+  sim_alarm_last_id = 0;
+  sim_alarm_due = NULL;
+}
+
+bool sim_alarm_next(absolute_time_t until, absolute_time_t* at) {
+  sim_alarm_due = NULL;
+  for (unsigned int p = 0; p < sim_alarm_pool_count; ++p) {
+    alarm_pool_t* pool = &sim_alarm_pools[p];
+    for (unsigned int i = 0; i < pool->max_timers; ++i) {
+      sim_alarm_t* alarm = &pool->alarms[i];
+      if (!alarm->active) continue;
+      absolute_time_t fires = MAX(alarm->time, pool->busy_until) + sim_alarm_latency_us;
+      if (fires <= until && (!sim_alarm_due || fires < *at)) {
+        sim_alarm_due = alarm;
+        *at = fires;
+      }
+    }
+  }
+  return sim_alarm_due != NULL;
+}
+
+void* sim_alarm_due_data() {
+  return sim_alarm_due->user_data;
+}
+
+void sim_alarm_fire() {
+  sim_alarm_t* alarm = sim_alarm_due;
+  sim_alarm_due = NULL;
+  alarm->pool->busy_until = time_us_64() + sim_alarm_cost_us;
+  alarm->active = false;
+  alarm->callback(alarm->id, alarm->user_data);
+}
@@ -0,0 +1,14 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_HOST_PICO_MULTICORE_H
+#define SIM_HOST_PICO_MULTICORE_H
+
+/** Each engine is a single thread, so there's no other core to lock out */
+static inline void multicore_lockout_start_blocking() {}
+static inline void multicore_lockout_end_blocking() {}
+
+#endif
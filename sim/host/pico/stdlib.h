@@ -0,0 +1,46 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Host stand-in for the bits of the Pico SDK the simulated modules use. Hardware is per thread,
+ * so every worker runs its engine against its own timer and pins.
+ */
+
+#ifndef SIM_HOST_PICO_STDLIB_H
+#define SIM_HOST_PICO_STDLIB_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pico/time.h>
+#include <hardware/gpio.h>
+
+typedef unsigned int uint;
+
+#define NUM_CORES 2
+#define PICO_ERROR_TIMEOUT -1
+
+#ifndef MIN
+#define MIN(a, b) ((b) > (a) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif
+
+#define panic(...) (fprintf(stderr, __VA_ARGS__), fputc('\n', stderr), abort())
+
+static inline uint get_core_num() { return 0; }
+static inline void tight_loop_contents() {}
+static inline void __wfi() {}
+static inline void __dmb() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+static inline int getchar_timeout_us(uint32_t timeout_us) { return PICO_ERROR_TIMEOUT; }
+static inline int putchar_raw(int c) { return c; }
+
+#endif
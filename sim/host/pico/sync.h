@@ -0,0 +1,23 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_HOST_PICO_SYNC_H
+#define SIM_HOST_PICO_SYNC_H
+
+#include <pico/stdlib.h>
+
+/** Each simulated engine lives on a single thread, so there's nothing to lock against */
+typedef struct { int unused; } spin_lock_t;
+
+static inline uint next_striped_spin_lock_num() { return 0; }
+static inline void spin_lock_claim(uint lock_num) {}
+static inline spin_lock_t* spin_lock_instance(uint lock_num) { return NULL; }
+static inline uint32_t spin_lock_blocking(spin_lock_t* lock) { return 0; }
+static inline void spin_unlock(spin_lock_t* lock, uint32_t saved) {}
+static inline uint32_t save_and_disable_interrupts() { return 0; }
+static inline void restore_interrupts(uint32_t saved) {}
+
+#endif
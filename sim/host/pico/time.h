@@ -0,0 +1,46 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_HOST_PICO_TIME_H
+#define SIM_HOST_PICO_TIME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <hardware/structs/timer.h>
+
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+typedef struct alarm_pool alarm_pool_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void* user_data);
+
+static inline absolute_time_t from_us_since_boot(uint64_t us) { return us; }
+static inline uint64_t time_us_64() { return (uint64_t) timer_hw->timerawh << 32 | timer_hw->timerawl; }
+
+/**
+ * Alarm pools of the calling thread's engine, one per simulated core. Alarms are one-shot, which
+ * is all the scheduler uses. Nothing fires on its own: the simulator asks for the next one with
+ * `sim_alarm_next` and runs it with `sim_alarm_fire` once it has moved the engine up to then.
+ */
+alarm_pool_t* alarm_pool_create(unsigned int hardware_alarm_num, unsigned int max_timers);
+alarm_id_t alarm_pool_add_alarm_at(alarm_pool_t* pool, absolute_time_t time, alarm_callback_t callback,
+  void* user_data, bool fire_if_past);
+
+/**
+ * Forget every pool, and model each alarm as firing `latency_us` after it's due, and keeping its
+ * core busy for `cost_us`. An alarm due while its core is still busy waits for it.
+ */
+void sim_alarm_reset(uint32_t latency_us, uint32_t cost_us);
+
+/** When the next alarm fires, if that's no later than `until` */
+bool sim_alarm_next(absolute_time_t until, absolute_time_t* at);
+
+/** Run the alarm `sim_alarm_next` found. The clock must have been moved up to its time. */
+void sim_alarm_fire();
+
+/** User data of the alarm `sim_alarm_next` found, to tell what it's going to run */
+void* sim_alarm_due_data();
+
+#endif
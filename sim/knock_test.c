@@ -0,0 +1,146 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Host test for knock detection. Runs the Goertzel filter and the retard logic on synthetic
+ * sensor windows: a tone at the knock frequency, a tone well away from it, and noise.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pico/stdlib.h>
+#include "config.h"
+#include "knock.h"
+#include "test.h"
+
+#define TEST_SAMPLES KNOCK_MAX_SAMPLES
+#define TEST_MIDSCALE 2048
+#define TEST_OFF_FREQUENCY_HZ 20000
+
+static int32_t test_coeff_q12(float frequency_hz) {
+  return 2.f * cosf(2.f * (float) M_PI * frequency_hz / KNOCK_SAMPLE_RATE_HZ) * (1 << 12);
+}
+
+static void test_tone(uint16_t* samples, float frequency_hz, float amplitude) {
+  for (int i = 0; i < TEST_SAMPLES; ++i) {
+    samples[i] = TEST_MIDSCALE + lroundf(amplitude * sinf(2.f * (float) M_PI * frequency_hz * i / KNOCK_SAMPLE_RATE_HZ));
+  }
+}
+
+static void test_noise(uint16_t* samples, uint32_t seed, int amplitude) {
+  for (int i = 0; i < TEST_SAMPLES; ++i) {
+    seed = seed * 1664525u + 1013904223u;
+    samples[i] = TEST_MIDSCALE + (int) (seed >> 16) % (2 * amplitude + 1) - amplitude;
+  }
+}
+
+/** Same filter in double precision, for checking the fixed point one against */
+static double test_reference(const uint16_t* samples, int32_t coeff_q12) {
+  double mean = 0;
+  for (int i = 0; i < TEST_SAMPLES; ++i) {
+    mean += samples[i];
+  }
+  mean = floor(mean / TEST_SAMPLES);
+
+  double coeff = coeff_q12 / 4096.0;
+  double s1 = 0;
+  double s2 = 0;
+  for (int i = 0; i < TEST_SAMPLES; ++i) {
+    double s0 = (samples[i] - mean) / 4 + coeff * s1 - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+  return (s1 * s1 + s2 * s2 - coeff * s1 * s2) / 256;
+}
+
+static void test_goertzel() {
+  uint16_t samples[TEST_SAMPLES];
+  int32_t coeff = test_coeff_q12(KNOCK_FREQUENCY_HZ);
+
+  // Full scale on frequency is where the filter state is biggest
+  test_tone(samples, KNOCK_FREQUENCY_HZ, 2000);
+  uint32_t full = knock_goertzel(samples, TEST_SAMPLES, coeff);
+  double reference = test_reference(samples, coeff);
+  CHECK(fabs(full - reference) < reference * 0.02, "full scale energy %u, reference %.0f", full, reference);
+
+  // Energy goes with amplitude squared
+  test_tone(samples, KNOCK_FREQUENCY_HZ, 1000);
+  uint32_t half = knock_goertzel(samples, TEST_SAMPLES, coeff);
+  CHECK(full > 3.5 * half && full < 4.5 * half, "full scale %u vs half scale %u", full, half);
+
+  test_tone(samples, TEST_OFF_FREQUENCY_HZ, 2000);
+  uint32_t off = knock_goertzel(samples, TEST_SAMPLES, coeff);
+  CHECK(off < full / 100, "off frequency energy %u vs on frequency %u", off, full);
+
+  test_noise(samples, 1, 200);
+  uint32_t noise = knock_goertzel(samples, TEST_SAMPLES, coeff);
+  CHECK(noise < full / 100, "noise energy %u vs on frequency %u", noise, full);
+
+  CHECK(knock_goertzel(samples, 0, coeff) == 0, "empty window has energy");
+}
+
+static void test_retard() {
+  uint16_t samples[TEST_SAMPLES];
+  int32_t coeff = test_coeff_q12(KNOCK_FREQUENCY_HZ);
+  Knock_t knock = knock_init(KNOCK_PIN, 1, KNOCK_FREQUENCY_HZ, KNOCK_WINDOW_START_DEGREES, KNOCK_WINDOW_END_DEGREES, KNOCK_THRESHOLD_Q4);
+  State_t state = {0};
+
+  // Engine background: some vibration, mostly away from the knock band
+  test_tone(samples, TEST_OFF_FREQUENCY_HZ, 1500);
+  uint32_t clean = knock_goertzel(samples, TEST_SAMPLES, coeff);
+  test_tone(samples, KNOCK_FREQUENCY_HZ, 400);
+  uint32_t knocking = knock_goertzel(samples, TEST_SAMPLES, coeff);
+
+  for (int i = 0; i < 32; ++i) {
+    knock_update_retard(knock, 0, clean);
+  }
+  CHECK(knock_get_retard(knock, &state) == 0, "retard %.1f after clean windows", knock_get_retard(knock, &state));
+
+  knock_update_retard(knock, 0, knocking);
+  CHECK(knock_get_retard(knock, &state) == KNOCK_RETARD_STEP, "retard %.1f after one knock", knock_get_retard(knock, &state));
+
+  knock_update_retard(knock, 0, clean);
+  float recovered = KNOCK_RETARD_STEP - KNOCK_RECOVER_STEP;
+  CHECK(fabsf(knock_get_retard(knock, &state) - recovered) < 1e-4f, "retard %.2f after recovering", knock_get_retard(knock, &state));
+
+  // Knock must not have dragged the floor up, or sustained knock would stop being detected
+  for (int i = 0; i < 20; ++i) {
+    knock_update_retard(knock, 0, knocking);
+  }
+  CHECK(knock_get_retard(knock, &state) == KNOCK_RETARD_MAX, "retard %.1f after sustained knock", knock_get_retard(knock, &state));
+}
+
+static void test_cylinders() {
+  Knock_t knock = knock_init(KNOCK_PIN, 4, KNOCK_FREQUENCY_HZ, KNOCK_WINDOW_START_DEGREES, KNOCK_WINDOW_END_DEGREES, KNOCK_THRESHOLD_Q4);
+  State_t state = {0};
+
+  // Set the floor, then knock on the cylinder at 540 degrees only
+  knock_update_retard(knock, 0, 1000);
+  knock_update_retard(knock, 3, 1000000);
+
+  state.cam_synced = true;
+  for (uint16_t phase = 0; phase < 720; phase += 180) {
+    state.phase = phase;
+    float expected = phase == 540 ? KNOCK_RETARD_STEP : 0;
+    CHECK(knock_get_retard(knock, &state) == expected, "retard %.1f at %u degrees", knock_get_retard(knock, &state), phase);
+  }
+
+  // Unsynced, 540 can't be told from 180, so they share a retard
+  state.cam_synced = false;
+  state.phase = 540;
+  float unsynced = knock_get_retard(knock, &state);
+  state.phase = 180;
+  CHECK(knock_get_retard(knock, &state) == unsynced, "retard %.1f at 180 against %.1f at 540 unsynced", knock_get_retard(knock, &state), unsynced);
+}
+
+int main() {
+  test_goertzel();
+  test_retard();
+  test_cylinders();
+
+  return test_result();
+}
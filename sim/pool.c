@@ -0,0 +1,81 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "pool.h"
+
+typedef struct pool_worker pool_worker_t;
+
+typedef struct pool {
+  pool_worker_t* workers;
+  size_t threads;
+  pool_task_func_t task;
+  void* context;
+} pool_t;
+
+struct pool_worker {
+  // Own cache line, the owner and thieves all hammer `next`
+  alignas(64) atomic_size_t next;
+  size_t end;
+  pool_t* pool;
+  pthread_t thread;
+};
+
+/**
+ * Claim tasks off of `victim`'s slice until it's empty. Owner and thieves claim the same way,
+ * so every index is handed out exactly once without a lock.
+ */
+static void pool_drain(pool_t* pool, pool_worker_t* victim) {
+  size_t index;
+  while ((index = atomic_fetch_add_explicit(&victim->next, 1, memory_order_relaxed)) < victim->end) {
+    pool->task(pool->context, index);
+  }
+}
+
+static void* pool_worker_main(void* param) {
+  pool_worker_t* self = param;
+  pool_t* pool = self->pool;
+  size_t id = self - pool->workers;
+
+  pool_drain(pool, self);
+  for (size_t i = 1; i < pool->threads; ++i) {
+    pool_drain(pool, &pool->workers[(id + i) % pool->threads]);
+  }
+
+  return NULL;
+}
+
+void pool_run(size_t count, size_t threads, pool_task_func_t task, void* context) {
+  threads = threads ? threads : 1;
+  pool_t pool = { .threads = threads, .task = task, .context = context };
+  pool.workers = aligned_alloc(alignof(pool_worker_t), sizeof(pool_worker_t) * threads);
+
+  for (size_t i = 0; i < threads; ++i) {
+    atomic_init(&pool.workers[i].next, count * i / threads);
+    pool.workers[i].end = count * (i + 1) / threads;
+    pool.workers[i].pool = &pool;
+  }
+
+  // The calling thread is worker 0
+  for (size_t i = 1; i < threads; ++i) {
+    pthread_create(&pool.workers[i].thread, NULL, pool_worker_main, &pool.workers[i]);
+  }
+  pool_worker_main(&pool.workers[0]);
+  for (size_t i = 1; i < threads; ++i) {
+    pthread_join(pool.workers[i].thread, NULL);
+  }
+
+  free(pool.workers);
+}
+
+size_t pool_default_threads() {
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  return threads > 0 ? threads : 1;
+}
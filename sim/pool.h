@@ -0,0 +1,26 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_POOL_H
+#define SIM_POOL_H
+
+#include <stddef.h>
+
+typedef void (*pool_task_func_t)(void* context, size_t index);
+
+/**
+ * Run `task` for every index in [0, count) on `threads` threads, and return once all are done.
+ * Each thread starts on its own contiguous slice and steals from the others' once it runs dry,
+ * so a few slow tasks don't leave the rest of the machine idle.
+ */
+void pool_run(size_t count, size_t threads, pool_task_func_t task, void* context);
+
+/**
+ * Number of hardware threads on this machine
+ */
+size_t pool_default_threads();
+
+#endif
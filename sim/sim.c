@@ -0,0 +1,316 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+/**
+ * Batch spark timing simulator.
+ *
+ * Runs the firmware's own trigger, schedulers and ignition against simulated engines, on the
+ * host (see engine.h). Every engine gets its own state store, firmware instances and alarm pools,
+ * and a crankshaft that follows an RPM profile. Alarms fire a little late and queue up behind
+ * each other on their core, so late and overflowed alarms show up like they would on the chip,
+ * and each spark is checked against where the crank actually was when the coil pin fell.
+ *
+ * Engines are every combination of profile and strategy, spread across all cores. The run fails
+ * if any strategy's sparks are off by more than the limits below.
+ *
+ * usage: deja_sim [-t threads] [-s seconds] [-n seeds] [-l latency_us] [-c cost_us]
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pico/stdlib.h>
+#include "state.h"
+#include "trigger.h"
+#include "ignition.h"
+#include "timing.h"
+#include "tune.h"
+#include "engine.h"
+#include "pool.h"
+
+/** Alarm latency and callback time on the M0+, IRQ entry and alarm pool included */
+#define SIM_DEFAULT_LATENCY_US 3
+#define SIM_DEFAULT_COST_US 4
+
+/** Planned sparks the coil may fail to fire, as a fraction of those it fired */
+#define SIM_MAX_MISSED_FRACTION 0.001
+
+typedef enum sim_profile_kind {SIM_STEADY, SIM_RAMP, SIM_SNAP, SIM_DECEL, SIM_PROFILE_KINDS} sim_profile_kind_t;
+
+static const char* SIM_PROFILE_NAMES[SIM_PROFILE_KINDS] = {"steady", "ramp", "snap", "decel"};
+
+/**
+ * Spark angle error each strategy has to stay within, in degrees, by profile. Predicting a whole
+ * period ahead can't keep up with a snap from idle or a hard decel, so those only get a loose
+ * bound on the total error: a spark a whole revolution late is on the wrong TDC. Over-advance is
+ * the direction that breaks engines, and is held tighter.
+ */
+typedef struct sim_limits {
+  double max_rms;
+  double max_abs;
+  double max_advance;
+} sim_limits_t;
+
+static const sim_limits_t SIM_LIMITS[SIM_PROFILE_KINDS] = {
+  [SIM_STEADY] = {7, 20, 20},
+  [SIM_RAMP] = {9, 35, 35},
+  [SIM_SNAP] = {32, 360, 30},
+  [SIM_DECEL] = {22, 180, 140},
+};
+
+typedef struct sim_profile {
+  sim_profile_kind_t kind;
+  float low_rpm;
+  float high_rpm;
+  float ripple;
+  float jitter;
+  uint32_t seed;
+  double seconds;
+} sim_profile_t;
+
+typedef struct sim_strategy {
+  const char* name;
+  timing_func_t timing;
+  dwell_func_t dwell;
+  /** Where the trigger sits, in degrees before TDC */
+  float trigger_degrees;
+} sim_strategy_t;
+
+static const sim_strategy_t SIM_STRATEGIES[] = {
+  {"static, trigger at TDC", timing_static, NULL, 0},
+  {"static, trigger 45 BTDC", timing_static, NULL, 45},
+  {"static, trigger 90 BTDC", timing_static, NULL, 90},
+  {"curved, trigger at TDC", timing_curved, NULL, 0},
+  {"curved, trigger 45 BTDC", timing_curved, NULL, 45},
+  {"mapped, trigger 45 BTDC", timing_mapped, dwell_mapped, 45},
+};
+
+#define SIM_STRATEGY_COUNT (sizeof(SIM_STRATEGIES) / sizeof(SIM_STRATEGIES[0]))
+
+typedef struct sim_case {
+  sim_profile_t profile;
+  const sim_strategy_t* strategy;
+  sim_stats_t stats;
+} sim_case_t;
+
+typedef struct sim_batch {
+  sim_case_t* cases;
+  uint32_t latency_us;
+  uint32_t cost_us;
+} sim_batch_t;
+
+/** Mean RPM the profile asks for at `t` seconds into the run */
+static double sim_profile_rpm(void* context, double t) {
+  const sim_profile_t* profile = context;
+  double low = profile->low_rpm;
+  double high = profile->high_rpm;
+  double seconds = profile->seconds;
+  double snap = 0.3 * seconds;
+
+  switch (profile->kind) {
+    case SIM_STEADY:
+      return high;
+    case SIM_RAMP:
+      return low + (high - low) * t / seconds;
+    case SIM_SNAP:
+      // Full throttle from idle: 300ms to redline
+      return t < snap ? low : MIN(high, low + (high - low) * (t - snap) / 0.3);
+    case SIM_DECEL:
+      return t < snap ? high : MAX(low, high - (high - low) * (t - snap) / 0.5);
+    default:
+      return low;
+  }
+}
+
+static void sim_case_run(void* context, size_t index) {
+  sim_batch_t* batch = context;
+  sim_case_t* run = &batch->cases[index];
+  sim_engine_config_t config = {
+    .timing = run->strategy->timing,
+    .dwell = run->strategy->dwell,
+    .trigger_degrees = run->strategy->trigger_degrees,
+    .ripple = run->profile.ripple,
+    .jitter = run->profile.jitter,
+    .seed = run->profile.seed,
+    .latency_us = batch->latency_us,
+    .cost_us = batch->cost_us,
+    .rpm = sim_profile_rpm,
+    .rpm_context = &run->profile
+  };
+  sim_engine_t engine;
+
+  sim_engine_init(&engine, &config);
+  sim_engine_run(&engine, run->profile.seconds);
+  sim_engine_finish(&engine);
+  run->stats = engine.stats;
+}
+
+static void sim_print_stats(const char* name, const sim_stats_t* stats) {
+  double mean = stats->sparks ? stats->sum / stats->sparks : 0;
+  double rms = stats->sparks ? sqrt(stats->sum_squares / stats->sparks) : 0;
+  printf("  %-26s %9llu %7llu %7llu %7llu %7llu %5llu %8.3f %8.3f %8.3f\n", name,
+    (unsigned long long) stats->sparks, (unsigned long long) stats->cut, (unsigned long long) stats->missed,
+    (unsigned long long) stats->unplanned, (unsigned long long) stats->late, (unsigned long long) stats->overflows,
+    mean, rms, stats->max_abs);
+}
+
+static void sim_print_header(const char* title) {
+  printf("\n%s\n  %-26s %9s %7s %7s %7s %7s %5s %8s %8s %8s\n", title, "",
+    "sparks", "cut", "missed", "crank", "late", "ovf", "mean", "rms", "max");
+}
+
+/** Every limit the run has to stay within. Prints whatever's over, and returns how many were. */
+static int sim_check(const sim_case_t* cases, size_t count) {
+  int failures = 0;
+
+  for (size_t strategy = 0; strategy < SIM_STRATEGY_COUNT; ++strategy)
+  for (int kind = 0; kind < SIM_PROFILE_KINDS; ++kind) {
+    const char* name = SIM_STRATEGIES[strategy].name;
+    const char* profile = SIM_PROFILE_NAMES[kind];
+    const sim_limits_t* limits = &SIM_LIMITS[kind];
+    sim_stats_t stats = { 0 };
+    for (size_t i = 0; i < count; ++i) {
+      if (cases[i].strategy == &SIM_STRATEGIES[strategy] && cases[i].profile.kind == kind) {
+        sim_stats_add(&stats, &cases[i].stats);
+      }
+    }
+
+    double rms = stats.sparks ? sqrt(stats.sum_squares / stats.sparks) : 0;
+    if (stats.sparks == 0) {
+      printf("FAIL %s, %s: no sparks\n", name, profile);
+      ++failures;
+    }
+    if (rms > limits->max_rms) {
+      printf("FAIL %s, %s: rms error %.3f over %.3f\n", name, profile, rms, limits->max_rms);
+      ++failures;
+    }
+    if (stats.max_abs > limits->max_abs) {
+      printf("FAIL %s, %s: error %.3f over %.3f\n", name, profile, stats.max_abs, limits->max_abs);
+      ++failures;
+    }
+    if (stats.max_advance > limits->max_advance) {
+      printf("FAIL %s, %s: over-advanced %.3f, over %.3f\n", name, profile, stats.max_advance, limits->max_advance);
+      ++failures;
+    }
+    if (stats.missed > stats.sparks * SIM_MAX_MISSED_FRACTION) {
+      printf("FAIL %s, %s: %llu planned sparks missed\n", name, profile, (unsigned long long) stats.missed);
+      ++failures;
+    }
+    // Nothing is due before it's scheduled while the engine holds its speed
+    if (kind == SIM_STEADY && stats.late) {
+      printf("FAIL %s, %s: %llu late alarms\n", name, profile, (unsigned long long) stats.late);
+      ++failures;
+    }
+    if (stats.overflows) {
+      printf("FAIL %s, %s: %llu alarm overflows\n", name, profile, (unsigned long long) stats.overflows);
+      ++failures;
+    }
+  }
+
+  return failures;
+}
+
+int main(int argc, char** argv) {
+  size_t threads = pool_default_threads();
+  double seconds = 5;
+  uint32_t seeds = 4;
+  uint32_t latency_us = SIM_DEFAULT_LATENCY_US;
+  uint32_t cost_us = SIM_DEFAULT_COST_US;
+  int option;
+
+  while ((option = getopt(argc, argv, "t:s:n:l:c:")) != -1) {
+    switch (option) {
+      case 't': threads = strtoul(optarg, NULL, 10); break;
+      case 's': seconds = strtod(optarg, NULL); break;
+      case 'n': seeds = strtoul(optarg, NULL, 10); break;
+      case 'l': latency_us = strtoul(optarg, NULL, 10); break;
+      case 'c': cost_us = strtoul(optarg, NULL, 10); break;
+      default:
+        fprintf(stderr, "usage: %s [-t threads] [-s seconds] [-n seeds] [-l latency_us] [-c cost_us]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  // timing_mapped reads the tune map. Flat, like the firmware boots with.
+  tune_init(TIMING_STATIC_VALUE, IGN_DWELL_US, TUNE_RPM_MAX);
+
+  static const float HIGH_RPM[] = {3000, 6000, 9000, 12000};
+  static const float RIPPLE[] = {0, 0.05f, 0.15f};
+  static const float JITTER[] = {0, 0.02f};
+  size_t count = SIM_PROFILE_KINDS * 4 * 3 * 2 * seeds * SIM_STRATEGY_COUNT;
+  sim_case_t* cases = calloc(count, sizeof(sim_case_t));
+  size_t n = 0;
+
+  for (int kind = 0; kind < SIM_PROFILE_KINDS; ++kind)
+  for (int h = 0; h < 4; ++h)
+  for (int r = 0; r < 3; ++r)
+  for (int j = 0; j < 2; ++j)
+  for (uint32_t s = 0; s < seeds; ++s)
+  for (size_t strategy = 0; strategy < SIM_STRATEGY_COUNT; ++strategy) {
+    cases[n].profile = (sim_profile_t) {
+      .kind = kind,
+      .low_rpm = 1500,
+      .high_rpm = HIGH_RPM[h],
+      .ripple = RIPPLE[r],
+      .jitter = JITTER[j],
+      .seed = 0x9E3779B9u * (s + 1),
+      .seconds = seconds
+    };
+    cases[n].strategy = &SIM_STRATEGIES[strategy];
+    ++n;
+  }
+
+  sim_batch_t batch = { .cases = cases, .latency_us = latency_us, .cost_us = cost_us };
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  pool_run(count, threads, sim_case_run, &batch);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+  printf("%zu engines x %.1fs simulated on %zu threads in %.2fs, alarms %uus late and %uus long\n",
+    count, seconds, threads, elapsed, latency_us, cost_us);
+
+  sim_print_header("Spark angle error by strategy (degrees, + is over-advanced)");
+  for (size_t strategy = 0; strategy < SIM_STRATEGY_COUNT; ++strategy) {
+    sim_stats_t stats = { 0 };
+    for (size_t i = 0; i < count; ++i) {
+      if (cases[i].strategy == &SIM_STRATEGIES[strategy]) sim_stats_add(&stats, &cases[i].stats);
+    }
+    sim_print_stats(SIM_STRATEGIES[strategy].name, &stats);
+  }
+
+  sim_print_header("Spark angle error by profile");
+  for (int kind = 0; kind < SIM_PROFILE_KINDS; ++kind) {
+    sim_stats_t stats = { 0 };
+    for (size_t i = 0; i < count; ++i) {
+      if (cases[i].profile.kind == kind) sim_stats_add(&stats, &cases[i].stats);
+    }
+    sim_print_stats(SIM_PROFILE_NAMES[kind], &stats);
+  }
+
+  sim_print_header("Spark angle error by ripple");
+  for (int r = 0; r < 3; ++r) {
+    sim_stats_t stats = { 0 };
+    char name[32];
+    snprintf(name, sizeof(name), "%.0f%%", RIPPLE[r] * 100);
+    for (size_t i = 0; i < count; ++i) {
+      if (cases[i].profile.ripple == RIPPLE[r]) sim_stats_add(&stats, &cases[i].stats);
+    }
+    sim_print_stats(name, &stats);
+  }
+
+  putchar('\n');
+  int failures = sim_check(cases, count);
+  free(cases);
+  if (failures) {
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
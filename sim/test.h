@@ -0,0 +1,38 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef SIM_TEST_H
+#define SIM_TEST_H
+
+#include <stdio.h>
+
+/**
+ * Minimal harness for the host tests. Each test is one executable: CHECK prints and counts
+ * failures without stopping, and main returns `test_result()`.
+ */
+
+static int failures = 0;
+
+#define CHECK(condition, ...) do { \
+  if (!(condition)) { \
+    printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+    printf(__VA_ARGS__); \
+    putchar('\n'); \
+    ++failures; \
+  } \
+} while (0)
+
+/** Print the outcome and return the exit code for ctest */
+static inline int test_result() {
+  if (failures) {
+    printf("%d failed\n", failures);
+    return 1;
+  }
+  printf("ok\n");
+  return 0;
+}
+
+#endif
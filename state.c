@@ -6,42 +6,93 @@
 
 #include <pico/sync.h>
 #include "state.h"
+#include "arena.h"
 
 typedef struct state_listener {
   state_listener_func_t update;
   void* param;
 } state_listener_t;
 
-static State_t state[2] = { { 0 }, { 0 } };
-static bool state_index;
-static spin_lock_t* state_spin_lock;
-static uint32_t state_spin_lock_save;
-static state_listener_t state_listeners[STATE_MAX_LISTENERS] = { 0 };
-static uint8_t state_num_listeners = 0;
+struct state_store {
+  State_t state[2];
+  bool index;
+  spin_lock_t* spin_lock;
+  uint32_t spin_lock_save;
+  state_listener_t listeners[STATE_MAX_LISTENERS];
+  uint8_t num_listeners;
+};
 
-void state_init() {
+static struct state_store state_singleton = { 0 };
+
+static void state_store_setup(StateStore_t store) {
   uint lock_num = next_striped_spin_lock_num();
   spin_lock_claim(lock_num);
-  state_spin_lock = spin_lock_instance(lock_num);
-  state_index = 0;
+  store->spin_lock = spin_lock_instance(lock_num);
+  store->index = 0;
 }
 
-State_t state_get() {
-  return state[state_index];
+StateStore_t state_store_init() {
+  StateStore_t store = arena_alloc(sizeof(struct state_store));
+  state_store_setup(store);
+
+  return store;
+}
+
+State_t state_store_get(StateStore_t store) {
+  return store->state[store->index];
 }
 
 // TODO: Consider copying state[index] to state[!index] here and returning a pointer
-State_t state_begin_write() {
-  state_spin_lock_save = spin_lock_blocking(state_spin_lock);
-  return state_get();
+State_t state_store_begin_write(StateStore_t store) {
+  store->spin_lock_save = spin_lock_blocking(store->spin_lock);
+  return state_store_get(store);
 }
 
-void state_commit_write(State_t* new_state) {
-  state[!state_index] = *new_state;
+void state_store_commit_write(StateStore_t store, State_t* new_state) {
+  bool clock_changed = store->state[store->index].clock != new_state->clock;
+  store->state[!store->index] = *new_state;
   // By swapping the state index, we make the update atomic from the reader's
   // perspective. This makes the race condition benign at the expense of doubling
   // the memory used to store the state, to the end of making reads non-blocking
-  state_index = !state_index;
-  spin_unlock(state_spin_lock, state_spin_lock_save);
+  store->index = !store->index;
+  spin_unlock(store->spin_lock, store->spin_lock_save);
+
+  if (clock_changed) {
+    for (uint8_t i = 0; i < store->num_listeners; ++i) {
+      store->listeners[i].update(new_state, store->listeners[i].param);
+    }
+  }
+}
+
+void state_store_add_listener(StateStore_t store, state_listener_func_t update, void* param) {
+  assert(store->num_listeners < STATE_MAX_LISTENERS);
+  store->listeners[store->num_listeners].update = update;
+  store->listeners[store->num_listeners].param = param;
+  // The trigger core may already be walking the list, so publish the entry before the count
+  __dmb();
+  ++store->num_listeners;
+}
+
+void state_init() {
+  state_store_setup(&state_singleton);
+}
+
+StateStore_t state_default_store() {
+  return &state_singleton;
+}
+
+State_t state_get() {
+  return state_store_get(&state_singleton);
+}
+
+State_t state_begin_write() {
+  return state_store_begin_write(&state_singleton);
+}
+
+void state_commit_write(State_t* new_state) {
+  state_store_commit_write(&state_singleton, new_state);
+}
 
+void state_add_listener(state_listener_func_t update, void* param) {
+  state_store_add_listener(&state_singleton, update, param);
 }
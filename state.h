@@ -8,15 +8,17 @@
 #define STATE_H
 
 #include <pico/stdlib.h>
+#include "tick.h"
 
-#define STATE_MAX_LISTENERS 4
+#define STATE_MAX_LISTENERS 8
 
 /** Use to get RPMs from Period */
 #define RPM(period) (6E7 / (period))
 
 typedef struct state State_t;
-typedef void (*state_listener_func_t)(State_t*);
-typedef uint64_t engine_clock_t;
+typedef struct state_store* StateStore_t;
+typedef void (*state_listener_func_t)(State_t*, void*);
+typedef uint32_t engine_clock_t;
 
 /**
  * Multicore-safe global state singleton.
@@ -39,8 +41,20 @@ struct state {
   /** Engine is physically moving */
   bool running;
 
-  /** Next top dead center. May or may not be a "waste spark" */
-  uint64_t next_tdc;
+  /** Engine is running but the trigger period hasn't settled yet. Don't predict from it */
+  bool cranking;
+
+  /** Cycles from the first trigger edge to the first predictive spark, for the last start */
+  uint16_t start_cycles;
+
+  /** Next top dead center. May or may not be a "waste spark" one, see `cam_synced` */
+  tick_t next_tdc;
+
+  /** The cam has pinned down which TDCs are compression TDCs. `phase` is only valid while set */
+  bool cam_synced;
+
+  /** Where next_tdc sits in the 720 degree engine cycle. 0 is cylinder 1's compression TDC */
+  uint16_t phase;
 
   /** Running degree clock value of next_tdc */
   engine_clock_t clock;
@@ -57,31 +71,58 @@ struct state {
   /** Head temperature in degrees celcius */
   uint8_t head_temp;
 
+  /** Battery (supply) voltage in millivolts */
+  uint16_t battery_voltage;
+
   /** User set trigger offset in degrees */
   float trigger_timing_offset; // TODO move to persistent config
 };
 
 /**
- * Initializes the state singleton with zero values
+ * Construct a new, zeroed state store. The firmware only needs the singleton below; extra
+ * stores are for running several engines side by side, like the simulator does.
  */
-void state_init();
+StateStore_t state_store_init();
 
 /**
  * Returns a safe copy of the engine state.
  */
-State_t state_get();
+State_t state_store_get(StateStore_t store);
 
 /**
  * Obtains a lock on the state and returns a safe copy for updating.
  * Please be fast, this disables interrupts for IRQ safety
  */
-State_t state_begin_write();
+State_t state_store_begin_write(StateStore_t store);
 
 /**
  * Atomically update the state from the write copy and release the lock.
- * To be used in conjuction with `state_begin_write()`.
+ * To be used in conjuction with `state_store_begin_write()`.
+ */
+void state_store_commit_write(StateStore_t store, State_t* new_state);
+
+/**
+ * Register a function to be called after every write that advances the engine clock, with the
+ * new state. Listeners run on the writer's core (the trigger), outside of the lock, so keep them
+ * short. Register at init, before the engine starts turning.
  */
+void state_store_add_listener(StateStore_t store, state_listener_func_t update, void* param);
+
+/**
+ * Initializes the state singleton with zero values
+ */
+void state_init();
+
+/**
+ * The state singleton's store, for modules that take one
+ */
+StateStore_t state_default_store();
+
+/** Singleton shorthands for the `state_store_*` functions */
+State_t state_get();
+State_t state_begin_write();
 void state_commit_write(State_t*);
+void state_add_listener(state_listener_func_t update, void* param);
 
 /** Neat lil state helper babies UwU */
 
@@ -89,8 +130,10 @@ void state_commit_write(State_t*);
 static inline void state_set_running(State_t* state, bool running) {
   if (!running) {
     state->clock = 0;
+    state->cam_synced = false;
   }
   state->running = running;
+  state->cranking = running;
 }
 
 #endif
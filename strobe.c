@@ -0,0 +1,69 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <pico/stdlib.h>
+#include <hardware/pio.h>
+#include <hardware/clocks.h>
+#include "strobe.h"
+#include "strobe.pio.h"
+#include "config.h"
+#include "arena.h"
+
+#define STROBE_PIO pio0
+
+struct strobe {
+  Ignition_t ignition;
+  uint sm;
+  uint32_t cycles_per_us;
+  bool at_spark;
+  float degrees;
+};
+
+Strobe_t strobe_init(Ignition_t ign) {
+  Strobe_t strobe = arena_alloc(sizeof(struct strobe));
+  strobe->ignition = ign;
+  strobe->cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+  strobe->at_spark = true;
+  strobe->degrees = 0;
+
+  uint offset = pio_add_program(STROBE_PIO, &strobe_program);
+  strobe->sm = pio_claim_unused_sm(STROBE_PIO, true);
+  strobe_program_init(STROBE_PIO, strobe->sm, offset, IGN_COIL_PIN, IGN_TIMING_LIGHT_PIN,
+    IGN_TIMING_LIGHT_PULSE_US * strobe->cycles_per_us);
+
+  return strobe;
+}
+
+void strobe_at_degrees(Strobe_t strobe, float degrees) {
+  strobe->degrees = degrees;
+  strobe->at_spark = false;
+}
+
+void strobe_at_spark(Strobe_t strobe) {
+  strobe->at_spark = true;
+}
+
+void strobe_listener(State_t* state, void* param) {
+  Strobe_t strobe = param;
+  const ignition_plan_t* plan = ignition_get_plan(strobe->ignition);
+
+  // Cut and cranking plans still hand over a delay, or the next spark would pull whatever angle
+  // was left over from the last one that ran on a plan. Cranking sparks come straight off the
+  // trigger, so those flash right on the spark.
+  uint32_t delay = 0;
+  if (!plan->cut && !strobe->at_spark && plan->advance > strobe->degrees) {
+    float delay_us = (plan->advance - strobe->degrees) * state->physical_period / 360.f;
+    delay = MAX((int32_t) (delay_us * strobe->cycles_per_us) - STROBE_OVERHEAD_CYCLES, 0);
+  }
+
+  // Every published delay is pulled by the dwell that follows it, so anything still queued is
+  // left over from a spark that never came (a cut or a stall). Drop it rather than lag a cycle
+  // behind.
+  if (!pio_sm_is_tx_fifo_empty(STROBE_PIO, strobe->sm)) {
+    pio_sm_clear_fifos(STROBE_PIO, strobe->sm);
+  }
+  pio_sm_put(STROBE_PIO, strobe->sm, delay);
+}
@@ -0,0 +1,43 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef STROBE_H
+#define STROBE_H
+
+#include <pico/stdlib.h>
+#include "state.h"
+#include "ignition.h"
+
+typedef struct strobe* Strobe_t;
+
+/**
+ * Timing light output on IGN_TIMING_LIGHT_PIN, pulsed for IGN_TIMING_LIGHT_PULSE_US on every
+ * spark. A PIO state machine watches IGN_COIL_PIN and times the pulse off of its falling edge,
+ * so the strobe takes no alarms and the coil output doesn't know it's there. `ign` is the
+ * ignition whose plans set the delay when flashing at an angle.
+ */
+Strobe_t strobe_init(Ignition_t ign);
+
+/**
+ * Flash at `degrees` BTDC instead of on the spark, to check the predictor against the timing
+ * marks. The flash can't come before the spark, so it's on the spark whenever `degrees` is more
+ * advanced than the timing.
+ */
+void strobe_at_degrees(Strobe_t strobe, float degrees);
+
+/**
+ * Flash on the spark again
+ */
+void strobe_at_spark(Strobe_t strobe);
+
+/**
+ * State listener that hands the state machine the delay for the coming spark. Only needed when
+ * flashing at an angle. Register after `ignition_plan_listener` and before core1's doorbell,
+ * so the delay is in place before the dwell starts.
+ */
+void strobe_listener(State_t* state, void* param);
+
+#endif
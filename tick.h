@@ -0,0 +1,58 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef TICK_H
+#define TICK_H
+
+#include <pico/stdlib.h>
+#include <hardware/structs/timer.h>
+
+/**
+ * 32-bit microsecond engine time base.
+ *
+ * 64-bit math is several instructions per op on the M0+, and the hot path never needs to look
+ * further than a few seconds ahead or behind. Ticks are the low word of the hardware timer and
+ * wrap every ~71 minutes, so they must only ever be compared through the helpers below, which
+ * are correct as long as the two times are within ~35 minutes of each other.
+ */
+typedef uint32_t tick_t;
+typedef int32_t tick_diff_t;
+
+/** Current time. A single register read, no latching of the high word */
+static inline tick_t tick_now() {
+  return timer_hw->timerawl;
+}
+
+/** Signed distance from `b` to `a` */
+static inline tick_diff_t tick_diff(tick_t a, tick_t b) {
+  return (tick_diff_t) (a - b);
+}
+
+/** `a` is strictly earlier than `b` */
+static inline bool tick_before(tick_t a, tick_t b) {
+  return tick_diff(a, b) < 0;
+}
+
+/** `a` is strictly later than `b` */
+static inline bool tick_after(tick_t a, tick_t b) {
+  return tick_diff(a, b) > 0;
+}
+
+/**
+ * Widen to 64 bits for the SDK's absolute time APIs: the current time, plus how far the tick is
+ * from it. Raw reads and a single 64-bit add, no latching `time_us_64()`.
+ */
+static inline absolute_time_t tick_to_absolute_time(tick_t tick) {
+  uint32_t high = timer_hw->timerawh;
+  tick_t now = timer_hw->timerawl;
+  if (timer_hw->timerawh != high && (int32_t) now >= 0) {
+    // The low word wrapped between the two reads, so `now` goes with the new high word
+    ++high;
+  }
+  return from_us_since_boot(((uint64_t) high << 32 | now) + tick_diff(tick, now));
+}
+
+#endif
@@ -9,6 +9,7 @@
 float timing_static(State_t* state) {
   return TIMING_STATIC_VALUE;
 }
+
 float timing_curved(State_t* state) {
   // Simple, naive curve (probably not usable)
   uint16_t rpm = RPM(state->physical_period);
@@ -20,3 +21,34 @@ float timing_curved(State_t* state) {
     return 10.0f;
   }
 }
+
+/**
+ * Bin of the current RPM along the tune map's axis, and the Q8 fraction towards the next one
+ */
+static inline uint8_t timing_map_bin(const tune_map_t* map, State_t* state, uint16_t* fraction) {
+  uint32_t rpm = state->physical_period ? 60000000u / state->physical_period : 0;
+  uint32_t position = (rpm << 8) / map->rpm_step;
+  if (position >= (TUNE_RPM_BINS - 1) << 8) {
+    *fraction = 256;
+    return TUNE_RPM_BINS - 2;
+  }
+  *fraction = position & 0xff;
+  return position >> 8;
+}
+
+float timing_mapped(State_t* state) {
+  const tune_map_t* map = tune_get();
+  uint16_t fraction;
+  uint8_t bin = timing_map_bin(map, state, &fraction);
+  int32_t advance = (map->advance[bin] * (256 - fraction) + map->advance[bin + 1] * fraction) >> 8;
+
+  return (advance + map->advance_offset) / 10.f;
+}
+
+uint32_t dwell_mapped(State_t* state) {
+  const tune_map_t* map = tune_get();
+  uint16_t fraction;
+  uint8_t bin = timing_map_bin(map, state, &fraction);
+
+  return (map->dwell_us[bin] * (256 - fraction) + map->dwell_us[bin + 1] * fraction) >> 8;
+}
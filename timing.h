@@ -9,13 +9,20 @@
 
 #include <pico/stdlib.h>
 #include "state.h"
+#include "tune.h"
 
 #define TIMING_STATIC_VALUE 16.0f
 
 typedef float (*timing_func_t)(State_t*);
+typedef uint32_t (*dwell_func_t)(State_t*);
 
 float timing_static(State_t* state);
 float timing_curved(State_t* state);
-//TODO: Read from file
+
+/** Advance interpolated from the live tune map */
+float timing_mapped(State_t* state);
+
+/** Dwell interpolated from the live tune map */
+uint32_t dwell_mapped(State_t* state);
 
 #endif
@@ -0,0 +1,77 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <pico/stdlib.h>
+#include "traction.h"
+#include "arena.h"
+#include "capture.h"
+#include "limiter.h"
+
+struct traction {
+  Capture_t driven;
+  Capture_t undriven;
+  float driven_scale;
+  float slip_target;
+  float slip_cut;
+  float min_speed_hz;
+  uint8_t max_retard_degrees;
+  bool cut_next;
+  float slip;
+};
+
+Traction_t traction_init(
+  Capture_t driven,
+  Capture_t undriven,
+  float driven_scale,
+  float slip_target,
+  float slip_cut,
+  uint8_t max_retard_degrees,
+  float min_speed_hz
+) {
+  Traction_t tc = arena_alloc(sizeof(struct traction));
+  tc->driven = driven;
+  tc->undriven = undriven;
+  tc->driven_scale = driven_scale;
+  tc->slip_target = slip_target;
+  tc->slip_cut = MAX(slip_cut, slip_target);
+  tc->min_speed_hz = min_speed_hz;
+  tc->max_retard_degrees = max_retard_degrees;
+  tc->cut_next = true;
+  tc->slip = 0;
+
+  return tc;
+}
+
+limiter_action_t traction_evaluate(Traction_t tc) {
+  limiter_action_t action = { .cut = false, .retard_degrees = 0 };
+  float undriven_hz = capture_frequency(tc->undriven);
+  float driven_hz = capture_frequency(tc->driven);
+
+  if (undriven_hz < tc->min_speed_hz || driven_hz == 0) {
+    tc->slip = 0;
+    return action;
+  }
+
+  tc->slip = (driven_hz / (undriven_hz * tc->driven_scale) - 1) * 100;
+  if (tc->slip < tc->slip_target) {
+    tc->cut_next = true;
+    return action;
+  }
+
+  if (tc->slip >= tc->slip_cut) {
+    action.retard_degrees = tc->max_retard_degrees;
+    action.cut = tc->cut_next;
+    tc->cut_next = !tc->cut_next;
+  } else {
+    action.retard_degrees = tc->max_retard_degrees * (tc->slip - tc->slip_target) / (tc->slip_cut - tc->slip_target);
+  }
+
+  return action;
+}
+
+float traction_slip(Traction_t tc) {
+  return tc->slip;
+}
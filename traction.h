@@ -0,0 +1,44 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef TRACTION_H
+#define TRACTION_H
+
+#include <pico/stdlib.h>
+#include "capture.h"
+#include "limiter.h"
+
+typedef struct traction* Traction_t;
+
+/**
+ * Construct a new traction control stage from a driven and an undriven wheel speed input.
+ * `driven_scale` is driven frequency / undriven frequency with no slip (tooth counts, tire
+ * sizes). Slip is the driven wheel's excess speed over the undriven one, in percent.
+ * Between `slip_target` and `slip_cut` the timing is retarded proportionally up to
+ * `max_retard_degrees`. Past `slip_cut` every other spark is cut too. Nothing happens below
+ * `min_speed_hz` on the undriven wheel, where slip can't be measured.
+ */
+Traction_t traction_init(
+  Capture_t driven,
+  Capture_t undriven,
+  float driven_scale,
+  float slip_target,
+  float slip_cut,
+  uint8_t max_retard_degrees,
+  float min_speed_hz
+);
+
+/**
+ * Work out what to do with the upcoming spark. Call once per cycle, from the plan listener.
+ */
+limiter_action_t traction_evaluate(Traction_t tc);
+
+/**
+ * Slip as of the last `traction_evaluate`, in percent. 0 while not measurable.
+ */
+float traction_slip(Traction_t tc);
+
+#endif
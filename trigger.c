@@ -7,43 +7,114 @@
 #include <pico/stdlib.h>
 #include <hardware/gpio.h>
 #include <hardware/adc.h>
+#include <hardware/irq.h>
 #include "trigger.h"
+#include "arena.h"
 #include "helpers.h"
 #include "state.h"
 #include "scheduler.h"
+#include "calibration.h"
+#include "tick.h"
+#include "cycles.h"
 
 struct trigger {
-  uint8_t pin;
   bool debounce;
-  uint8_t local_frequency; // TODO: Move to config (not state)
-  uint64_t last_trigger;
+  tick_t last_trigger;
   float timing_offset_degrees;
-  uint64_t clock;
-  bool (*read)(Trigger_t);
+  engine_clock_t clock;
+  uint32_t last_period;
+  uint8_t stable_periods;
+  Calibration_t calibration;
+  StateStore_t store;
+#ifdef CAM_PIN
+  volatile bool cam_seen;
+  uint8_t cam_confirmations;
+  /** Engine cycle position of the predicted TDC, in crank edges */
+  uint8_t edge;
+#endif
 };
 
+/**
+ * Offset to apply for this trigger. Uses the calibrated table once there is one,
+ * otherwise the user set offset. Without a sense input, that's also what gets recorded while
+ * calibrating.
+ */
+static inline float trigger_offset_degrees(Trigger_t trig, State_t* state, uint32_t physical_period) {
+  Calibration_t cal = trig->calibration;
+  if (!cal) {
+    return state->trigger_timing_offset;
+  }
+  if (calibration_active(cal)) {
+#ifndef CALIBRATION_SENSE_PIN
+    calibration_record(cal, physical_period, state->trigger_timing_offset);
+#endif
+    return state->trigger_timing_offset;
+  }
+  if (calibration_valid(cal)) {
+    return calibration_correction(cal, physical_period);
+  }
+  return state->trigger_timing_offset;
+}
+
+/**
+ * Advance the engine phase by one crank edge and check it against the cam. The cam edge has to
+ * land right before the CAM_SYNC_EDGE crank edge every cycle. One out of place, or a whole cycle
+ * without one, drops back to wasted spark until it has been seen in place again a few times.
+ */
+static inline void trigger_update_phase(Trigger_t trig, State_t* update) {
+#ifdef CAM_PIN
+  trig->edge = (trig->edge + 1) % TRIGGER_EDGES_PER_CYCLE;
+  if (trig->cam_seen) {
+    trig->cam_seen = false;
+    bool in_place = trig->edge == CAM_SYNC_EDGE;
+    trig->cam_confirmations = in_place ? MIN(trig->cam_confirmations + 1, TRIGGER_CAM_CONFIRM_CYCLES) : 0;
+    trig->edge = CAM_SYNC_EDGE;
+  } else if (trig->edge == CAM_SYNC_EDGE) {
+    trig->cam_confirmations = 0;
+  }
+  update->cam_synced = trig->cam_confirmations >= TRIGGER_CAM_CONFIRM_CYCLES;
+  update->phase = trig->edge * (360 / TRIGGERS_PER_REVOLUTION);
+#endif
+}
+
 static inline void trigger_update_state(Trigger_t trig) {
-  uint64_t current_time = to_us_since_boot(get_absolute_time());
+  tick_t current_time = tick_now();
 
-  uint64_t trigger_period = current_time - trig->last_trigger;
-  uint16_t physical_period = trigger_period * trig->local_frequency;
+  uint32_t trigger_period = current_time - trig->last_trigger;
+  uint32_t physical_period = trigger_period * TRIGGERS_PER_REVOLUTION;
 
-  State_t state = state_get();
-  float timing_offset_degrees = state.trigger_timing_offset + trig->timing_offset_degrees;
-  uint64_t timing_offset_us = physical_period * (timing_offset_degrees / 360.f);
+  State_t state = state_store_get(trig->store);
+  float timing_offset_degrees = trigger_offset_degrees(trig, &state, physical_period) + trig->timing_offset_degrees;
+  int32_t timing_offset_us = physical_period * (timing_offset_degrees / 360.f);
 
-  State_t update = state_begin_write();
+  // Count consecutive periods within tolerance of the last one to know when cranking is over
+  uint32_t tolerance = trig->last_period >> TRIGGER_STABLE_SHIFT;
+  bool stable = trig->last_period
+    && trigger_period <= trig->last_period + tolerance
+    && trigger_period + tolerance >= trig->last_period;
+  trig->stable_periods = stable ? MIN(trig->stable_periods + 1, TRIGGER_CRANK_STABLE_PERIODS) : 0;
+  trig->last_period = trigger_period;
+
+  State_t update = state_store_begin_write(trig->store);
   update.physical_period = physical_period;
   update.ignition_period = trigger_period;
   update.next_tdc = current_time + trigger_period + timing_offset_us;
   ++update.clock;
-  state_commit_write(&update);
+  trigger_update_phase(trig, &update);
+  if (update.cranking && trig->stable_periods >= TRIGGER_CRANK_STABLE_PERIODS) {
+    update.cranking = false;
+    update.start_cycles = update.clock;
+  }
+  state_store_commit_write(trig->store, &update);
 
   trig->last_trigger = current_time;
 }
 
+/** The trigger the GPIO handlers work for */
+static ARENA_CORE_LOCAL Trigger_t trigger_irq_owner;
+
 static bool trigger_read_analog(Trigger_t trig) {
-  uint64_t millivolts = read_adc_channel(trig->pin - ADC_CHANNEL_OFFSET);
+  uint32_t millivolts = read_adc_channel(TRIGGER_PIN - ADC_CHANNEL_OFFSET);
   if (millivolts  > 100 && !trig->debounce) {
     trig->debounce = true;
     return true;
@@ -53,48 +124,121 @@ static bool trigger_read_analog(Trigger_t trig) {
   return false;
 }
 
-static bool trigger_read_digital() {
-  // TODO
+/** Latch cam rising edges until the next crank edge picks them up */
+static void trigger_cam_irq() {
+#ifdef CAM_PIN
+  if (!(gpio_get_irq_event_mask(CAM_PIN) & GPIO_IRQ_EDGE_RISE)) return;
+  gpio_acknowledge_irq(CAM_PIN, GPIO_IRQ_EDGE_RISE);
+  trigger_irq_owner->cam_seen = true;
+#endif
+}
+
+static void trigger_edge(Trigger_t trig) {
+  State_t state = state_store_get(trig->store);
+  if (!state.running) {
+    // Engine is running again!
+    State_t update = state_store_begin_write(trig->store);
+    state_set_running(&update, true);
+    state_store_commit_write(trig->store, &update);
+
+    // The period since the last run is meaningless, and so is the phase
+    trig->last_period = 0;
+    trig->stable_periods = 0;
+#ifdef CAM_PIN
+    trig->cam_confirmations = 0;
+#endif
+  } else if ((uint32_t) (tick_now() - trig->last_trigger) < TRIGGER_GLITCH_US) {
+    return;
+  }
+  trigger_update_state(trig);
+}
+
+/**
+ * Rising edge on the digital trigger. Same priority as the alarm IRQ, so it never lands in the
+ * middle of a scheduler callback writing the state, and those can't delay it by more than their
+ * own run time.
+ */
+static void trigger_pin_irq() {
+  if (!(gpio_get_irq_event_mask(TRIGGER_PIN) & GPIO_IRQ_EDGE_RISE)) return;
+#if CYCLE_COUNT
+  uint32_t cycles_start = cycles_now();
+#endif
+  gpio_acknowledge_irq(TRIGGER_PIN, GPIO_IRQ_EDGE_RISE);
+  trigger_edge(trigger_irq_owner);
+#if CYCLE_COUNT
+  cycles_record(trigger_pin_irq, cycles_start);
+#endif
 }
 
-Trigger_t trigger_init(
-  enum trigger_type type,
-  uint8_t pin,
-  uint8_t local_frequency,
-  float timing_offset_degrees
-) {
-  Trigger_t trig = malloc(sizeof(struct trigger));
-  trig->pin = pin;
-  trig->local_frequency = local_frequency;
+Trigger_t trigger_init(float timing_offset_degrees) {
+  Trigger_t trig = arena_alloc(sizeof(struct trigger));
+  trig->timing_offset_degrees = timing_offset_degrees;
   trig->last_trigger = 0;
   trig->clock = 0;
+  trig->last_period = 0;
+  trig->stable_periods = 0;
+  trig->calibration = NULL;
+  trig->store = state_default_store();
 
-  if (type == TRIGGER_COIL_ANALOG) {
-    adc_gpio_init(pin);
-    trig->read = trigger_read_analog;
-  } else if (type == TRIGGER_COIL_DIGITAL) {
-    trig->read = trigger_read_digital;
+  trigger_irq_owner = trig;
+
+#ifdef CAM_PIN
+  trig->cam_seen = false;
+  trig->cam_confirmations = 0;
+  trig->edge = 0;
+  gpio_init(CAM_PIN);
+  gpio_set_dir(CAM_PIN, GPIO_IN);
+  gpio_add_raw_irq_handler(CAM_PIN, trigger_cam_irq);
+  gpio_set_irq_enabled(CAM_PIN, GPIO_IRQ_EDGE_RISE, true);
+#endif
+
+  if (TRIGGER_TYPE == TRIGGER_COIL_ANALOG) {
+    adc_gpio_init(TRIGGER_PIN);
+  } else {
+    gpio_init(TRIGGER_PIN);
+    gpio_set_dir(TRIGGER_PIN, GPIO_IN);
+    gpio_add_raw_irq_handler(TRIGGER_PIN, trigger_pin_irq);
+    gpio_set_irq_enabled(TRIGGER_PIN, GPIO_IRQ_EDGE_RISE, true);
   }
+  irq_set_enabled(IO_IRQ_BANK0, true);
 
   return trig;
 }
 
+/**
+ * Time without an edge after which the engine is considered stopped. Scales with the last
+ * period so a stall is caught within a few revolutions rather than a fixed second.
+ */
+static inline uint32_t trigger_stall_timeout(Trigger_t trig) {
+  if (trig->last_period == 0) {
+    return TRIGGER_TIMEOUT_PERIOD;
+  }
+  if (trig->last_period >= TRIGGER_TIMEOUT_PERIOD / TRIGGER_STALL_PERIODS) {
+    return TRIGGER_TIMEOUT_PERIOD;
+  }
+  return trig->last_period * TRIGGER_STALL_PERIODS;
+}
+
 void trigger_event_callback(event_t* event) {
   Trigger_t trig = event->param;
-  bool triggered = trig->read(trig);
-  State_t state = state_get();
-  if (triggered) {
-    if (!state.running) {
-      // Engine is running again!
-      State_t update = state_begin_write();
-      state_set_running(&update, true);
-      state_commit_write(&update);
-    }
-    trigger_update_state(trig);
-  } else if (state.running && time_us_64() - trig->last_trigger > TRIGGER_TIMEOUT_PERIOD) {
+  // The profile's trigger type is a constant, so this compiles out for the digital one
+  if (TRIGGER_TYPE == TRIGGER_COIL_ANALOG && trigger_read_analog(trig)) {
+    trigger_edge(trig);
+    return;
+  }
+  State_t state = state_store_get(trig->store);
+  if (state.running && (uint32_t) (tick_now() - trig->last_trigger) > trigger_stall_timeout(trig)) {
     // Engine has stopped
-    State_t update = state_begin_write();
+    State_t update = state_store_begin_write(trig->store);
     state_set_running(&update, false);
-    state_commit_write(&update);
+    state_store_commit_write(trig->store, &update);
   }
 }
+
+void trigger_set_calibration(Trigger_t trig, Calibration_t cal) {
+  trig->calibration = cal;
+}
+
+void trigger_set_state_store(Trigger_t trig, StateStore_t store) {
+  trig->store = store;
+}
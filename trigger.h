@@ -8,24 +8,65 @@
 #define TRIGGER_H
 
 #include <pico/stdlib.h>
+#include "config.h"
 #include "scheduler.h"
+#include "calibration.h"
 
-#define TRIGGER_POLL_PERIOD 20
 #define TRIGGER_TIMEOUT_PERIOD 1000000
+/** Engine is considered stalled after this many trigger periods without an edge */
+#define TRIGGER_STALL_PERIODS 3
+/** Consecutive stable periods before leaving cranking mode */
+#define TRIGGER_CRANK_STABLE_PERIODS 4
+/** A period is stable if within 1/2^n of the previous one */
+#define TRIGGER_STABLE_SHIFT 3
+/** Crank edges in one 720 degree engine cycle */
+#define TRIGGER_EDGES_PER_CYCLE (2 * TRIGGERS_PER_REVOLUTION)
+/** Consecutive cam edges in the expected spot before the phase is trusted */
+#define TRIGGER_CAM_CONFIRM_CYCLES 2
+/** Edges this soon after the last one are noise. About what a TRIGGER_POLL_PERIOD poll filtered */
+#define TRIGGER_GLITCH_US 20
+/** Stall check period, when edges come in by IRQ and don't need polling */
+#define TRIGGER_STALL_POLL_PERIOD 1000
+/** Period to schedule `trigger_event_callback` at */
+#define TRIGGER_EVENT_PERIOD (TRIGGER_TYPE == TRIGGER_COIL_ANALOG ? TRIGGER_POLL_PERIOD : TRIGGER_STALL_POLL_PERIOD)
 
 enum trigger_type{TRIGGER_COIL_ANALOG, TRIGGER_COIL_DIGITAL};
 typedef enum trigger_type trigger_type_t;
 
+#ifdef KNOCK_PIN
+// The analog trigger reads the ADC every poll, and the knock window free-runs it into DMA
+static_assert(TRIGGER_TYPE != TRIGGER_COIL_ANALOG, "The analog trigger shares the ADC with knock. Leave KNOCK_PIN undefined");
+#endif
+
 typedef struct trigger* Trigger_t;
 typedef void (*trigger_callback_t)(void);
 
-Trigger_t trigger_init(
-  trigger_type_t type,
-  uint8_t pin,
-  uint8_t local_frequency,
-  float timing_offset_degrees
-);
+/**
+ * Construct the trigger described by the profile: TRIGGER_TYPE on TRIGGER_PIN, with
+ * TRIGGERS_PER_REVOLUTION edges per revolution. `timing_offset_degrees` is where the trigger
+ * sits before TDC. If the profile has a CAM_PIN, its rising edges are latched by a GPIO IRQ and
+ * decoded on the next crank edge to keep `state.phase` and `state.cam_synced` up to date.
+ *
+ * The digital trigger takes its edges by GPIO IRQ on the calling core, so an idle core sleeps
+ * until the crank moves, and the edge is timed to the IRQ entry rather than to a poll. The
+ * analog one has to be sampled, by `trigger_event_callback`. Only one trigger per core.
+ */
+Trigger_t trigger_init(float timing_offset_degrees);
 
+/**
+ * Scheduler event, every TRIGGER_EVENT_PERIOD µs on the core the trigger was built on. Samples the
+ * analog trigger, and notices when the engine has stopped.
+ */
 void trigger_event_callback(event_t* event);
 
+/**
+ * Use a calibrated, RPM dependent offset table in place of the user set offset. NULL to disable.
+ */
+void trigger_set_calibration(Trigger_t trig, Calibration_t cal);
+
+/**
+ * Write to `store` instead of the state singleton. Set before the trigger starts polling.
+ */
+void trigger_set_state_store(Trigger_t trig, StateStore_t store);
+
 #endif
@@ -0,0 +1,204 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#include <stdio.h>
+#include <pico/stdlib.h>
+#include <pico/sync.h>
+#include "tune.h"
+#include "state.h"
+#include "idle.h"
+#include "cycles.h"
+
+#define TUNE_MAX_DWELL_US 10000
+
+typedef enum tune_parse {TUNE_PARSE_SYNC, TUNE_PARSE_COMMAND, TUNE_PARSE_LENGTH, TUNE_PARSE_PAYLOAD, TUNE_PARSE_CHECKSUM} tune_parse_t;
+
+typedef struct tune_frame {
+  tune_parse_t parse;
+  uint8_t command;
+  uint8_t length;
+  uint8_t received;
+  uint8_t sum;
+  uint8_t payload[TUNE_MAX_PAYLOAD];
+} tune_frame_t;
+
+// Same trick as the state: the live map is swapped by index, the other copy is the shadow
+static tune_map_t tune_maps[2];
+static volatile bool tune_index;
+static volatile bool tune_pending;
+static tune_frame_t tune_frame;
+
+void tune_init(float advance, uint16_t dwell_us, uint16_t rpm_max) {
+  tune_map_t* map = &tune_maps[0];
+  for (uint8_t i = 0; i < TUNE_RPM_BINS; ++i) {
+    map->advance[i] = advance * 10;
+    map->dwell_us[i] = dwell_us;
+  }
+  map->advance_offset = 0;
+  map->rpm_step = MAX(rpm_max / (TUNE_RPM_BINS - 1), 1);
+  tune_maps[1] = tune_maps[0];
+  tune_index = 0;
+  tune_pending = false;
+  tune_frame.parse = TUNE_PARSE_SYNC;
+}
+
+const tune_map_t* tune_get() {
+  return &tune_maps[tune_index];
+}
+
+static void tune_publish() {
+  tune_index = !tune_index;
+  // Start the next round of edits from what's live
+  tune_maps[!tune_index] = tune_maps[tune_index];
+  tune_pending = false;
+}
+
+void tune_listener(State_t* state, void* param) {
+  if (tune_pending) {
+    tune_publish();
+  }
+}
+
+static void tune_reply(uint8_t command, const uint8_t* payload, uint8_t length) {
+  uint8_t sum = command + length;
+  putchar_raw(TUNE_SYNC);
+  putchar_raw(command);
+  putchar_raw(length);
+  for (uint8_t i = 0; i < length; ++i) {
+    putchar_raw(payload[i]);
+    sum += payload[i];
+  }
+  putchar_raw(sum);
+}
+
+static void tune_nack(uint8_t error) {
+  tune_reply(TUNE_NACK, &error, 1);
+}
+
+/** Pointer to a table cell in `map`, or NULL if out of range */
+static int16_t* tune_cell(tune_map_t* map, uint8_t table, uint8_t index) {
+  switch (table) {
+    case TUNE_ADVANCE:
+      return index < TUNE_RPM_BINS ? &map->advance[index] : NULL;
+    case TUNE_DWELL:
+      return index < TUNE_RPM_BINS ? (int16_t*) &map->dwell_us[index] : NULL;
+    case TUNE_ADVANCE_OFFSET:
+      return index == 0 ? &map->advance_offset : NULL;
+  }
+  return NULL;
+}
+
+static void tune_execute(tune_frame_t* frame) {
+  uint8_t* payload = frame->payload;
+  uint8_t reply_command = frame->command | TUNE_REPLY;
+  int16_t* cell;
+
+  switch (frame->command) {
+    case TUNE_READ:
+      cell = frame->length == 2 ? tune_cell((tune_map_t*) tune_get(), payload[0], payload[1]) : NULL;
+      if (!cell) {
+        tune_nack(TUNE_ERROR_RANGE);
+      } else {
+        uint8_t reply[4] = { payload[0], payload[1], *cell & 0xff, (uint16_t) *cell >> 8 };
+        tune_reply(reply_command, reply, sizeof(reply));
+      }
+      break;
+
+    case TUNE_WRITE:
+      cell = frame->length == 4 ? tune_cell(&tune_maps[!tune_index], payload[0], payload[1]) : NULL;
+      int16_t value = payload[2] | payload[3] << 8;
+      if (tune_pending) {
+        tune_nack(TUNE_ERROR_BUSY);
+      } else if (!cell || (payload[0] == TUNE_DWELL && (uint16_t) value > TUNE_MAX_DWELL_US)) {
+        tune_nack(TUNE_ERROR_RANGE);
+      } else {
+        *cell = value;
+        tune_reply(reply_command, payload, 4);
+      }
+      break;
+
+    case TUNE_COMMIT: {
+      State_t state = state_get();
+      if (state.running) {
+        // Published by the trigger at the next cycle boundary
+        tune_pending = true;
+      } else {
+        // No cycle boundary is coming. Make sure the trigger doesn't start one mid-swap
+        uint32_t interrupts = save_and_disable_interrupts();
+        tune_publish();
+        restore_interrupts(interrupts);
+      }
+      uint8_t reply[4] = { state.clock, state.clock >> 8, state.clock >> 16, state.clock >> 24 };
+      tune_reply(reply_command, reply, sizeof(reply));
+      break;
+    }
+
+    case TUNE_STATUS: {
+      State_t state = state_get();
+      uint16_t status[5] = {
+        idle_load(0), idle_peak_load(0), idle_load(1), idle_peak_load(1), state.start_cycles
+      };
+      tune_reply(reply_command, (const uint8_t*) status, sizeof(status));
+      break;
+    }
+
+    case TUNE_CYCLES: {
+      const cycles_stats_t* stats = frame->length == 2 ? cycles_get(payload[0], payload[1]) : NULL;
+      if (!stats) {
+        tune_nack(TUNE_ERROR_RANGE);
+        break;
+      }
+      uint32_t cycles[6] = {
+        payload[0], payload[1], (uintptr_t) stats->what, stats->calls, stats->total / stats->calls, stats->max
+      };
+      tune_reply(reply_command, (const uint8_t*) cycles, sizeof(cycles));
+      break;
+    }
+
+    default:
+      tune_nack(TUNE_ERROR_COMMAND);
+  }
+}
+
+void tune_poll() {
+  tune_frame_t* frame = &tune_frame;
+  int c;
+
+  while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+    uint8_t byte = c;
+    switch (frame->parse) {
+      case TUNE_PARSE_SYNC:
+        if (byte == TUNE_SYNC) frame->parse = TUNE_PARSE_COMMAND;
+        break;
+      case TUNE_PARSE_COMMAND:
+        frame->command = byte;
+        frame->sum = byte;
+        frame->parse = TUNE_PARSE_LENGTH;
+        break;
+      case TUNE_PARSE_LENGTH:
+        frame->length = byte;
+        frame->received = 0;
+        frame->sum += byte;
+        frame->parse = byte == 0 ? TUNE_PARSE_CHECKSUM : TUNE_PARSE_PAYLOAD;
+        // Can't be one of ours, resync
+        if (byte > TUNE_MAX_PAYLOAD) frame->parse = TUNE_PARSE_SYNC;
+        break;
+      case TUNE_PARSE_PAYLOAD:
+        frame->payload[frame->received++] = byte;
+        frame->sum += byte;
+        if (frame->received == frame->length) frame->parse = TUNE_PARSE_CHECKSUM;
+        break;
+      case TUNE_PARSE_CHECKSUM:
+        if (byte == frame->sum) {
+          tune_execute(frame);
+        } else {
+          tune_nack(TUNE_ERROR_CHECKSUM);
+        }
+        frame->parse = TUNE_PARSE_SYNC;
+        break;
+    }
+  }
+}
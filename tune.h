@@ -0,0 +1,81 @@
+/**
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ */
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <pico/stdlib.h>
+#include "state.h"
+
+#define TUNE_RPM_BINS 16
+
+/**
+ * Live tuning protocol, over USB CDC (stdio).
+ *
+ * Frames in both directions are:
+ *   TUNE_SYNC, command, length, payload[length], checksum
+ * where checksum is the 8-bit sum of command, length and payload. All values are little endian.
+ * Replies echo the command with TUNE_REPLY set. Errors reply with TUNE_NACK and an error code.
+ *
+ *   TUNE_READ   table, index          -> table, index, value (int16, from the live map)
+ *   TUNE_WRITE  table, index, value   -> table, index, value (to the shadow map)
+ *   TUNE_COMMIT                       -> clock the map was requested on (uint32)
+ *   TUNE_STATUS                       -> load and peak load of core0, then core1 (uint16, per mille),
+ *                                        then cycles to the first predictive spark on the last
+ *                                        start (uint16)
+ *   TUNE_CYCLES core, slot            -> core, slot, callback address, calls, then mean and max
+ *                                        cycles per call (uint32 each). Needs CYCLE_COUNT, see
+ *                                        cycles.h
+ *
+ * Writes only ever touch the shadow map. A commit publishes it at the next cycle boundary, so
+ * the spark path never sees a half written table. Writes are refused until the commit lands.
+ */
+#define TUNE_SYNC 0xDE
+#define TUNE_REPLY 0x80
+#define TUNE_NACK 0x7F
+#define TUNE_MAX_PAYLOAD 8
+
+enum tune_command {TUNE_READ = 1, TUNE_WRITE = 2, TUNE_COMMIT = 3, TUNE_STATUS = 4, TUNE_CYCLES = 5};
+enum tune_table {TUNE_ADVANCE = 0, TUNE_DWELL = 1, TUNE_ADVANCE_OFFSET = 2};
+enum tune_error {TUNE_ERROR_CHECKSUM = 1, TUNE_ERROR_COMMAND, TUNE_ERROR_RANGE, TUNE_ERROR_BUSY};
+
+typedef struct tune_map tune_map_t;
+
+struct tune_map {
+  /** Advance in tenths of a degree BTDC, per RPM bin */
+  int16_t advance[TUNE_RPM_BINS];
+
+  /** Dwell in µs, per RPM bin */
+  uint16_t dwell_us[TUNE_RPM_BINS];
+
+  /** Tenths of a degree added to the whole advance table */
+  int16_t advance_offset;
+
+  /** RPM between bins, bin 0 is 0 RPM */
+  uint16_t rpm_step;
+};
+
+/**
+ * Initialize both maps flat with `advance` and `dwell_us`, with bins up to `rpm_max`
+ */
+void tune_init(float advance, uint16_t dwell_us, uint16_t rpm_max);
+
+/**
+ * The live map. Only valid until the next cycle boundary, so read it from a state listener.
+ */
+const tune_map_t* tune_get();
+
+/**
+ * State listener that publishes a committed shadow map. Register it before any listener reading the map.
+ */
+void tune_listener(State_t* state, void* param);
+
+/**
+ * Process whatever bytes have arrived over USB. Call from the main loop, never from an IRQ.
+ */
+void tune_poll();
+
+#endif